@@ -0,0 +1,63 @@
+/*
+ * Example of an external output sink: appends every reading to a CSV file.
+ *
+ * Build with `make sinks` and load with:
+ *   temp_daemon -d /dev/ttyUSB0 --sink=build/sinks/csv_sink.so:/tmp/temperature.csv
+ */
+#include <stdio.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+
+static void *csv_open(const char *args)
+{
+    FILE *f = fopen(args, "a");
+
+    if (f == NULL) {
+        perror("Error opening CSV file");
+    }
+
+    return f;
+}
+
+static int csv_write(void *ctx, const temp_snapshot_t *snap)
+{
+    FILE *f = (FILE *) ctx;
+
+    for (int t = 0; t < snap->thermo_count; t++) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        const uint8_t *addr = thermo->address;
+
+        if (thermo->status != TEMP_STATUS_OK) {
+            continue;
+        }
+
+        int w = fprintf(f, "%ld,%02X%02X%02X%02X%02X%02X%02X%02X,%.4f\n",
+            snap->uptime,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7],
+            thermo->temperature
+        );
+
+        if (w < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int csv_flush(void *ctx)
+{
+    return fflush((FILE *) ctx);
+}
+
+static void csv_close(void *ctx)
+{
+    fclose((FILE *) ctx);
+}
+
+const temp_sink_api_t temp_sink = {
+    TEMP_SINK_ABI, "csv", csv_open, csv_write, csv_flush, csv_close
+};
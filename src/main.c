@@ -26,9 +26,12 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/sysinfo.h>
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <errno.h>
+#include <math.h>
 
 #include "onewire.h"
 #include "ow_driver_linux_usart.h"
@@ -37,6 +40,22 @@
 #include "temp_types.h"
 #include "temp_output.h"
 #include "mqtt_output.h"
+#include "temp_schedule.h"
+#include "temp_health.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_registry.h"
+#include "temp_family.h"
+#include "temp_filter.h"
+#include "temp_aggregate.h"
+#include "temp_time.h"
+#include "temp_record.h"
+#include "temp_rt.h"
+#include "temp_deadline.h"
+#include "temp_alert.h"
+#include "temp_log.h"
+#include "temp_query.h"
+#include "temp_integrity.h"
 
 #define V_MAJOR 0
 #define V_MINOR 1
@@ -46,9 +65,28 @@ static int opt_daemon = 0;
 static int opt_verbose = 0;
 static int opt_full_scratchpad = 0;
 static int opt_median = 0;
+static int opt_filter_dummy = 0;
+static int opt_median_window = 5; // Count of last readings to take median of
+static float opt_spike = 0; // Reject readings differing from median more than this
+static float opt_ema = 0; // Weight of new reading in moving average
+
+static long int opt_window = 0; // Publish aggregates over this period instead of every reading
 static int opt_check_crc = 0;
+static int opt_crc_adaptive = 0; // Read 2 bytes, in full with CRC only when suspect
+static int opt_integrity_dummy = 0;
+static float opt_crc_jump = 5; // Change from the last good value to check in full
 static long int opt_address_query_period = 300; // How often to retrieve addresses of One Wire devices
 static long int opt_read_period = 60; // How often to read temperatures from Dallas devices
+static uint64_t read_period_ns = 60 * NS_PER_S; // The same, may be below a second
+static int opt_resolution = 0; // Resolution to set sensors to, 0 to keep theirs
+static int opt_hf_dummy = 0;
+static int quiet_cycles = 0; // Do not log every cycle when sampling fast
+
+static int opt_adaptive = 0;
+static int opt_adaptive_dummy = 0;
+static long int opt_read_min = 10; // Bounds of adaptive per-sensor read interval
+static long int opt_read_max = 600;
+static float opt_adapt_delta = 0.25; // Temperature change to aim for between two reads
 
 static int opt_tsv = 0;
 static char *output_tsv = NULL;
@@ -56,21 +94,112 @@ static char *output_tsv = NULL;
 static int opt_json = 0;
 static char *output_json = NULL;
 
+static char *output_binary = NULL;
+
 static int opt_mqtt = 0;
 static int opt_mqtt_dummy = 0;
 static char *mqtt_server = NULL;
 static int mqtt_port = 1883;
 static char *mqtt_topic = "darauble/temp_daemon";
+static int opt_mqtt5 = 0;
+static long opt_mqtt_expiry = -1; // Expiry of per-sensor messages, -1 for twice the publish period
+static int opt_mqtt_binary = 0; // Single binary batch instead of per-sensor topics
 
 /* One Wire structures */
 static wire_t *wires = NULL;
 static int wire_count = 0;
 static int wire_max_count = 0;
 
+/* External output sinks, loaded from shared objects */
+#define EXT_SINK_MAX 8
+
+static char *ext_sinks[EXT_SINK_MAX];
+static int ext_sink_count = 0;
+static int opt_sink_dummy = 0;
+static int opt_sink_queue = 2;
+static int opt_sink_policy = SINK_POLICY_DROP;
+
+/* File keeping sensor ids and aliases across restarts */
+static int opt_registry_dummy = 0;
+static char *registry_file = NULL;
+
+/* Datagram output for high frequency sampling */
+static char *unix_socket = NULL;
+
+/* Report sink counters and reading age every this many seconds */
+static long opt_stats = 0;
+static long stats_start = 0;
+
+/* Recording or replay of 1-Wire traffic */
+static int opt_record_dummy = 0;
+static char *record_file = NULL;
+static char *replay_file = NULL;
+
+/* Real-time scheduling, CPU pinning and memory locking of wire threads */
+static int opt_rt_dummy = 0;
+static int opt_sched = -1; // SCHED_FIFO or SCHED_RR, -1 to keep the default
+static int opt_sched_priority = 10;
+static int opt_mlock = 0;
+
+/* Per-wire deadline of read cycles and what to shed once it is missed */
+#define SHED_SEARCH 0x01 // Postpone periodic search
+#define SHED_CRC 0x02 // No CRC retries
+#define SHED_DUE 0x04 // Read only sensors which fit before the deadline, the rest first next cycle
+#define SHED_CYCLES 10 // Shed load for this many cycles after a missed deadline
+
+static int opt_deadline_dummy = 0;
+static uint64_t opt_deadline_ns = 0; // 0 for none
+static int opt_shed = SHED_SEARCH | SHED_CRC | SHED_DUE;
+static unsigned long late_cycles = 0;
+
+/* Threshold and rate of change alerts */
+static int opt_alert_dummy = 0;
+static char *alert_file = NULL;
+static char *alert_socket = NULL;
+
+/* Level of the asynchronous log, -1 for info, or debug with -v */
+static int opt_log_dummy = 0;
+static int opt_log_level = -1;
+
+/* On-demand reads of single sensors */
+static int opt_query_dummy = 0;
+static int opt_mqtt_read = 0;
+static char *read_socket = NULL;
+
+#define ADDR_FMT "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X"
+#define ADDR_ARGS(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5], (a)[6], (a)[7]
+#define ADDR_TEXT_SIZE 24
+
+/* ROM as text, the key of per-sensor log limits */
+static const char *addr_text(const uint8_t *address, char *text)
+{
+    snprintf(text, ADDR_TEXT_SIZE, ADDR_FMT, ADDR_ARGS(address));
+
+    return text;
+}
+
+/* Duration of read cycles, for the statistics */
+static unsigned long cycle_count = 0;
+static double cycle_sum = 0;
+static double cycle_sq_sum = 0;
+static uint64_t cycle_max = 0;
+/* Since the last report, counted by wire threads as they happen, so sensors moved or gone do not matter */
+static atomic_ulong crc_error_count = 0;
+static atomic_ulong escalation_count = 0;
+
 /* Timers */
-static long last_uptime = 0;
+static long window_start = 0;
 static long current_uptime = 0;
 
+/* Wire workers are started once and woken up for every read cycle */
+static pthread_mutex_t cycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cycle_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cycle_done = PTHREAD_COND_INITIALIZER;
+static unsigned long cycle_seq = 0;
+static int cycle_running = 0;
+static int cycle_stop = 0;
+static int workers_started = 0;
+
 
 /* Function headers */
 void usage();
@@ -78,11 +207,26 @@ void usage();
 static int init_wire(wire_t *);
 static void release_wires();
 static int collect_thermometers(wire_t *);
+static int wire_move(wire_t *, thermometer_t *);
+static void wire_take_moved(wire_t *);
 static int read_temperatures(wire_t *);
 static int create_daemon();
 void *temp_thread(void *);
-
-static void print_address(uint8_t *);
+static int wire_cycle(wire_t *);
+static int start_workers();
+static void run_cycle(uint64_t);
+static void stop_workers();
+static void wake_workers();
+static int read_now(wire_t *, thermometer_t *, float *);
+static int open_sinks();
+
+static int sensor_due(wire_t *, thermometer_t *);
+static int read_scratchpad(wire_t *, thermometer_t *, int, uint8_t, int *);
+static void close_window();
+static void set_resolution(wire_t *, thermometer_t *);
+static void report_cycles();
+static int parse_shed(const char *);
+static int parse_log_level(const char *);
 
 int main(int argc, char **argv)
 {
@@ -100,9 +244,43 @@ int main(int argc, char **argv)
         {"mqtt_server",  required_argument, &opt_mqtt, 1},
         {"mqtt_port",    required_argument, &opt_mqtt_dummy, 1},
         {"mqtt_topic",   required_argument, &opt_mqtt_dummy, 1},
+        {"read_min",     required_argument, &opt_adaptive_dummy, 1},
+        {"read_max",     required_argument, &opt_adaptive_dummy, 1},
+        {"adapt_delta",  required_argument, &opt_adaptive_dummy, 1},
+        {"sink",         required_argument, &opt_sink_dummy, 1},
+        {"sink_queue",   required_argument, &opt_sink_dummy, 1},
+        {"sink_policy",  required_argument, &opt_sink_dummy, 1},
+        {"registry",     required_argument, &opt_registry_dummy, 1},
+        {"median_window", required_argument, &opt_filter_dummy, 1},
+        {"spike",        required_argument, &opt_filter_dummy, 1},
+        {"ema",          required_argument, &opt_filter_dummy, 1},
+        {"window",       required_argument, &opt_filter_dummy, 1},
+        {"resolution",   required_argument, &opt_hf_dummy, 1},
+        {"unix_socket",  required_argument, &opt_hf_dummy, 1},
+        {"stats",        required_argument, &opt_sink_dummy, 1},
+        {"record",       required_argument, &opt_record_dummy, 1},
+        {"replay",       required_argument, &opt_record_dummy, 1},
+        {"mqtt5",        no_argument,       &opt_mqtt5, 1},
+        {"mqtt_expiry",  required_argument, &opt_mqtt_dummy, 1},
+        {"binary",       required_argument, &opt_sink_dummy, 1},
+        {"mqtt_binary",  no_argument,       &opt_mqtt_binary, 1},
+        {"sched",        required_argument, &opt_rt_dummy, 1},
+        {"sched_priority", required_argument, &opt_rt_dummy, 1},
+        {"cpus",         required_argument, &opt_rt_dummy, 1},
+        {"mlock",        no_argument,       &opt_mlock, 1},
+        {"deadline",     required_argument, &opt_deadline_dummy, 1},
+        {"shed",         required_argument, &opt_deadline_dummy, 1},
+        {"alerts",       required_argument, &opt_alert_dummy, 1},
+        {"alert_socket", required_argument, &opt_alert_dummy, 1},
+        {"log_level",    required_argument, &opt_log_dummy, 1},
+        {"read_socket",  required_argument, &opt_query_dummy, 1},
+        {"mqtt_read",    no_argument,       &opt_mqtt_read, 1},
+        {"crc_adaptive", no_argument,       &opt_crc_adaptive, 1},
+        {"crc_jump",     required_argument, &opt_integrity_dummy, 1},
         /* These options don’t set a flag.
             We distinguish them by their indices. */
         {"daemon",          no_argument,       0, 'D'},
+        {"adaptive",        no_argument,       0, 'a'},
         {"full_scratchpad", no_argument,       0, 'F'},
         {"crc8",            no_argument,       0, 'c'},
         {"median",          no_argument,       0, 'm'},
@@ -127,7 +305,7 @@ int main(int argc, char **argv)
 
     while(1) {
 
-        c = getopt_long(argc, argv, "DFcmd:hq:r:v", long_options, &opt_idx);
+        c = getopt_long(argc, argv, "DaFcmd:hq:r:v", long_options, &opt_idx);
 
         if (c < 0) {
             break;
@@ -138,6 +316,10 @@ int main(int argc, char **argv)
                 opt_daemon = 1;
             break;
 
+            case 'a':
+                opt_adaptive = 1;
+            break;
+
             case 'F':
                 opt_full_scratchpad = 1;
             break;
@@ -162,11 +344,15 @@ int main(int argc, char **argv)
                     wire_max_count += WIRE_COUNT_STEP;
                 }
 
+                wires[wire_count].num = wire_count;
                 wires[wire_count].last_query = 0;
                 wires[wire_count].driver = NULL;
                 wires[wire_count].status = TEMP_STATUS_FAIL; // Uninitialized wire
                 wires[wire_count].device = optarg;
                 wires[wire_count].thermometers = NULL;
+                wires[wire_count].moved = NULL;
+                wires[wire_count].moved_count = 0;
+                wires[wire_count].moved_max = 0;
 
                 wire_count++;
             break;
@@ -180,8 +366,19 @@ int main(int argc, char **argv)
                 opt_address_query_period = strtol(optarg, NULL, 10);
             break;
 
-            case 'r':
-                opt_read_period = strtol(optarg, NULL, 10);
+            case 'r': {
+                /* Fractions of a second are allowed, e.g. 0.1 */
+                double period = strtod(optarg, NULL);
+
+                if (period <= 0) {
+                    fprintf(stderr, "Read period should be positive.\n");
+                    return_main = -1;
+                    goto EXIT_MAIN;
+                }
+
+                read_period_ns = period * NS_PER_S;
+                opt_read_period = (period < 1) ? 1 : (long) period;
+            }
             break;
 
             case 'v':
@@ -220,6 +417,218 @@ int main(int argc, char **argv)
                         /* MQTT topic set */
                         mqtt_topic = optarg;
                     break;
+
+                    case 6:
+                        /* Minimal adaptive read interval */
+                        opt_read_min = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 7:
+                        /* Maximal adaptive read interval */
+                        opt_read_max = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 8:
+                        /* Temperature change to aim for between reads */
+                        opt_adapt_delta = strtof(optarg, NULL);
+                    break;
+
+                    case 9:
+                        /* External output sink */
+                        if (ext_sink_count >= EXT_SINK_MAX) {
+                            fprintf(stderr, "Too many sinks, at most %d supported.\n", EXT_SINK_MAX);
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+
+                        ext_sinks[ext_sink_count++] = optarg;
+                    break;
+
+                    case 10: {
+                        /* Queue size of every sink, or of sinks of one name */
+                        const char *value = strchr(optarg, '=');
+
+                        if (value == NULL) {
+                            opt_sink_queue = strtol(optarg, NULL, 10);
+                        } else if (sink_override(optarg, value - optarg, strtol(value + 1, NULL, 10), -1) != 0) {
+                            fprintf(stderr, "Invalid sink queue %s.\n", optarg);
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    }
+                    break;
+
+                    case 11: {
+                        /* What to do if sink's queue is full, for every sink or for sinks of one name */
+                        const char *value = strchr(optarg, '=');
+                        int policy;
+
+                        if (strcmp((value != NULL) ? value + 1 : optarg, "block") == 0) {
+                            policy = SINK_POLICY_BLOCK;
+                        } else if (strcmp((value != NULL) ? value + 1 : optarg, "drop") == 0) {
+                            policy = SINK_POLICY_DROP;
+                        } else {
+                            fprintf(stderr, "Sink policy should be either drop or block.\n");
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+
+                        if (value == NULL) {
+                            opt_sink_policy = policy;
+                        } else if (sink_override(optarg, value - optarg, -1, policy) != 0) {
+                            fprintf(stderr, "Invalid sink policy %s.\n", optarg);
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    }
+                    break;
+
+                    case 12:
+                        /* Sensor registry file */
+                        registry_file = optarg;
+                    break;
+
+                    case 13:
+                        /* Median window */
+                        opt_median_window = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 14:
+                        /* Spike rejection limit */
+                        opt_spike = strtof(optarg, NULL);
+                    break;
+
+                    case 15:
+                        /* Moving average weight */
+                        opt_ema = strtof(optarg, NULL);
+                    break;
+
+                    case 16:
+                        /* Aggregates window */
+                        opt_window = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 17:
+                        /* Sensor resolution */
+                        opt_resolution = strtol(optarg, NULL, 10);
+
+                        if (opt_resolution < 9 || opt_resolution > 12) {
+                            fprintf(stderr, "Resolution should be 9 to 12 bits.\n");
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    break;
+
+                    case 18:
+                        /* Unix datagram socket output */
+                        unix_socket = optarg;
+                    break;
+
+                    case 19:
+                        /* Sink statistics period */
+                        opt_stats = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 20:
+                        /* Record 1-Wire traffic */
+                        record_file = optarg;
+                    break;
+
+                    case 21:
+                        /* Replay recorded 1-Wire traffic instead of adapters */
+                        replay_file = optarg;
+                    break;
+
+                    case 23:
+                        /* MQTT 5 message expiry */
+                        opt_mqtt_expiry = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 24:
+                        /* Binary output defined */
+                        output_binary = optarg;
+                    break;
+
+                    case 26:
+                        /* Real-time policy of wire threads */
+                        if (strcmp(optarg, "fifo") == 0) {
+                            opt_sched = SCHED_FIFO;
+                        } else if (strcmp(optarg, "rr") == 0) {
+                            opt_sched = SCHED_RR;
+                        } else {
+                            fprintf(stderr, "Scheduling policy should be fifo or rr.\n");
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    break;
+
+                    case 27:
+                        /* Real-time priority of wire threads */
+                        opt_sched_priority = strtol(optarg, NULL, 10);
+                    break;
+
+                    case 28:
+                        /* CPUs to pin wire threads to */
+                        if (rt_parse_cpus(optarg) != 0) {
+                            fprintf(stderr, "Bad CPU list %s, e.g. 2,3 or 1-3 expected.\n", optarg);
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    break;
+
+                    case 30:
+                        /* Deadline of every wire in a read cycle */
+                        {
+                            double deadline = strtod(optarg, NULL);
+
+                            if (deadline < 0) {
+                                fprintf(stderr, "Deadline should not be negative.\n");
+                                return_main = -1;
+                                goto EXIT_MAIN;
+                            }
+
+                            opt_deadline_ns = deadline * NS_PER_S;
+                        }
+                    break;
+
+                    case 31:
+                        /* What to shed after a missed deadline */
+                        if (parse_shed(optarg) != 0) {
+                            fprintf(stderr, "Shedding should be none or a list of search, crc and due.\n");
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    break;
+
+                    case 32:
+                        /* Alert rules */
+                        alert_file = optarg;
+                    break;
+
+                    case 33:
+                        /* Unix datagram socket for alerts */
+                        alert_socket = optarg;
+                    break;
+
+                    case 34:
+                        opt_log_level = parse_log_level(optarg);
+
+                        if (opt_log_level < 0) {
+                            fprintf(stderr, "Log level should be error, warn, info or debug.\n");
+                            return_main = -1;
+                            goto EXIT_MAIN;
+                        }
+                    break;
+
+                    case 35:
+                        /* Unix datagram socket for on-demand reads */
+                        read_socket = optarg;
+                    break;
+
+                    case 38:
+                        /* Jump to check the sensor in full for */
+                        opt_crc_jump = strtof(optarg, NULL);
+                    break;
                 }
             break;
         }
@@ -237,12 +646,40 @@ int main(int argc, char **argv)
         goto EXIT_MAIN;
     }
 
-    if (output_tsv == NULL && output_json == NULL && mqtt_server == NULL) {
-        fprintf(stderr, "Provide at least one output: TSV, JSON or MQTT.\n");
+    if (output_tsv == NULL && output_json == NULL && output_binary == NULL && mqtt_server == NULL
+        && unix_socket == NULL && ext_sink_count == 0) {
+        fprintf(stderr, "Provide at least one output: TSV, JSON, binary, MQTT, Unix socket or external sink.\n");
         return_main = -3;
         goto EXIT_MAIN;
     }
 
+    if (record_file != NULL && replay_file != NULL) {
+        fprintf(stderr, "Either record or replay, not both.\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
+
+    /* Reads at any time would not replay where they were recorded */
+    if ((read_socket != NULL || opt_mqtt_read) && (record_file != NULL || replay_file != NULL)) {
+        fprintf(stderr, "On-demand reads cannot be recorded nor replayed.\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
+
+    if (opt_mqtt_read && mqtt_server == NULL) {
+        fprintf(stderr, "On-demand reads over MQTT need --mqtt_server.\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
+
+    if (opt_sched >= 0 && (opt_sched_priority < sched_get_priority_min(opt_sched)
+        || opt_sched_priority > sched_get_priority_max(opt_sched))) {
+        fprintf(stderr, "Priority should be between %d and %d.\n",
+            sched_get_priority_min(opt_sched), sched_get_priority_max(opt_sched));
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
+
     if (opt_daemon) {
         return_main = create_daemon();
         
@@ -262,8 +699,86 @@ int main(int argc, char **argv)
             printf("Write output to %s\n", output_json);
         }
 
+        if (output_binary != NULL) {
+            printf("Write output to %s\n", output_binary);
+        }
+
         if (mqtt_server != NULL) {
             printf("Send output to MQTT: %s:%d @ %s\n", mqtt_server, mqtt_port, mqtt_topic);
+
+            if (opt_mqtt5) {
+                printf("Use MQTT 5 if the server supports it\n");
+            }
+        }
+
+        if (unix_socket != NULL) {
+            printf("Send output to Unix socket %s\n", unix_socket);
+        }
+
+        for (int i = 0; i < ext_sink_count; i++) {
+            printf("Send output to sink %s\n", ext_sinks[i]);
+        }
+
+        printf("Read period %.3f s", (double) read_period_ns / NS_PER_S);
+
+        if (opt_resolution > 0) {
+            printf(", %d bit resolution", opt_resolution);
+        }
+
+        printf("\n");
+
+        if (opt_median || opt_spike > 0 || opt_ema > 0) {
+            printf("Filter: median of %d, spike limit %.2f C, EMA weight %.2f\n",
+                opt_median ? opt_median_window : 1, opt_spike, opt_ema);
+        }
+
+        if (opt_crc_adaptive) {
+            printf("Adaptive CRC checks: jump limit %.2f C\n", opt_crc_jump);
+        }
+
+        if (opt_window > 0) {
+            printf("Publish min/max/mean/last over %ld s window\n", opt_window);
+        }
+
+        if (opt_adaptive) {
+            printf("Adaptive read interval: %ld..%ld s, aiming for %.2f C change\n",
+                opt_read_min, opt_read_max, opt_adapt_delta);
+        }
+
+        if (record_file != NULL) {
+            printf("Record 1-Wire traffic to %s\n", record_file);
+        }
+
+        if (replay_file != NULL) {
+            printf("Replay 1-Wire traffic from %s\n", replay_file);
+        }
+
+        if (opt_sched >= 0) {
+            printf("Run device threads as %s, priority %d\n", rt_policy_name(opt_sched), opt_sched_priority);
+        }
+
+        if (alert_file != NULL) {
+            printf("Check alert rules of %s", alert_file);
+
+            if (alert_socket != NULL) {
+                printf(", send alerts to Unix socket %s", alert_socket);
+            }
+
+            printf("\n");
+        }
+
+        if (read_socket != NULL) {
+            printf("Take on-demand read requests on Unix socket %s\n", read_socket);
+        }
+
+        if (opt_mqtt_read) {
+            printf("Take on-demand read requests from MQTT %s/read\n", mqtt_topic);
+        }
+
+        if (opt_deadline_ns > 0) {
+            printf("Deadline of devices %.3f s, shed%s%s%s\n", (double) opt_deadline_ns / NS_PER_S,
+                (opt_shed & SHED_SEARCH) ? " search" : "", (opt_shed & SHED_CRC) ? " crc" : "",
+                (opt_shed & SHED_DUE) ? " due" : (opt_shed ? "" : " nothing"));
         }
 
         printf("USART devices:\n");
@@ -274,7 +789,7 @@ int main(int argc, char **argv)
     }
 
     for (int i = 0; i < wire_count; i++) {
-        wires[i].thermometers = malloc(THERMO_COUNT_STEP * sizeof(thermometer_t));
+        wires[i].thermometers = malloc(THERMO_COUNT_STEP * sizeof(thermometer_t *));
         wires[i].thermo_count = 0;
         wires[i].thermo_max = THERMO_COUNT_STEP;
 
@@ -285,191 +800,693 @@ int main(int argc, char **argv)
         }
     }
 
-    if (mqtt_server != NULL) {
-        mqtt_open(mqtt_server, mqtt_port, mqtt_topic);
-    }
-
-    while (1) {
-        struct sysinfo s_info;
-        int err = sysinfo(&s_info);
-        if (err != 0) {
-            fprintf(stderr, "Cannot read uptime, daemon cannot run, exiting.\n");
-            goto EXIT_MAIN;
-        }
+    schedule_config(opt_adaptive, opt_read_period, opt_read_min, opt_read_max, opt_adapt_delta);
+    health_config(opt_read_period);
+    filter_config(opt_median ? opt_median_window : 1, opt_spike, opt_ema);
+    integrity_config(opt_crc_jump);
 
-        current_uptime = s_info.uptime;
-    
+    if (opt_adaptive) {
+        /* Cycle at the shortest interval, each cycle reads only sensors that are due */
+        opt_read_period = opt_read_min;
+        read_period_ns = opt_read_min * NS_PER_S;
+    }
 
-        if (current_uptime - last_uptime >= opt_read_period) {
-            for (int i = 0; i < wire_count; i++) {
-                pthread_create(&wires[i].tid, NULL, temp_thread, (void *) &wires[i]);
-            }
+    quiet_cycles = (read_period_ns < NS_PER_S) && !opt_verbose;
 
-            for (int i = 0; i < wire_count; i++) {
-                pthread_join(wires[i].tid, NULL);
-            }
+    /* A cycle takes the conversion and then the reads, it cannot be any shorter */
+    uint64_t conversion_min_ns = family_conversion_ns(family_get(FAMILY_DS18B20), opt_resolution);
 
-            last_uptime = current_uptime;
+    if (read_period_ns <= conversion_min_ns) {
+        fprintf(stderr, "Warning: read period of %.3f s is not longer than the conversion, %.0f ms, "
+            "every cycle will run late.\n", (double) read_period_ns / NS_PER_S, (double) conversion_min_ns / NS_PER_MS);
+    }
 
-            if (opt_tsv) {
-                out_tsv(output_tsv, wires, wire_count);
-            }
+    /* Past the period, the next cycle would already be due */
+    if (opt_deadline_ns > read_period_ns) {
+        opt_deadline_ns = read_period_ns;
+    }
 
-            if (opt_json) {
-                out_json(output_json, wires, wire_count);
-            }
+    /* Replay cancels where the recording did, not by the clock */
+    if (replay_file != NULL) {
+        opt_deadline_ns = 0;
+    }
 
-            if (mqtt_server != NULL) {
-                mqtt_send(wires, wire_count);
-            }
+    /* A conversion which does not fit is never started, so its sensors would be shed in every cycle */
+    if (opt_deadline_ns > 0) {
+        uint64_t conversion_max_ns = family_conversion_ns(family_get(FAMILY_DS18S20), opt_resolution);
 
-            printf("[%ld] Temperatures read.\n", current_uptime);
+        if (opt_deadline_ns <= conversion_min_ns) {
+            fprintf(stderr, "Deadline of %.3f s is not longer than the conversion, %.0f ms, no sensor would ever be read.\n",
+                (double) opt_deadline_ns / NS_PER_S, (double) conversion_min_ns / NS_PER_MS);
+            return_main = -1;
+            goto EXIT_MAIN;
         }
 
-        sleep(1);
+        if (opt_deadline_ns <= conversion_max_ns) {
+            fprintf(stderr, "Warning: deadline of %.3f s is not longer than the conversion of DS18S20 sensors, %.0f ms, "
+                "devices with them would never be read.\n",
+                (double) opt_deadline_ns / NS_PER_S, (double) conversion_max_ns / NS_PER_MS);
+        }
     }
 
-EXIT_MAIN:
-    if (opt_verbose) {
-        printf("Exit temp_daemon\n");
+    if (deadline_init() != 0 || deadline_cond_init(&cycle_done) != 0) {
+        fprintf(stderr, "Could not set up deadlines\n");
+        return_main = -1;
+        goto EXIT_MAIN;
     }
 
-    release_wires();
+    rt_config(opt_sched, opt_sched_priority, opt_mlock, opt_verbose);
 
-    if (wires) {
-        for (int i = 0; i < wire_count; i++) {
-            if (wires[i].thermometers) {
-                free(wires[i].thermometers);
-            }
-        }
-        free(wires);
+    /* Before any thread is started, so their stacks are locked too */
+    rt_lock_memory();
+
+    if (opt_log_level < 0) {
+        opt_log_level = opt_verbose ? LOG_DEBUG : LOG_INFO;
     }
 
-    return return_main;
-}
+    if (log_open(opt_log_level) != 0) {
+        fprintf(stderr, "Could not start logging thread\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-void *temp_thread(void *wire_v)
-{
-    __label__ EXIT_THREAD;
+    if (record_file != NULL && record_open(record_file) != 0) {
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-    wire_t *wire = (wire_t *) wire_v;
+    if (replay_file != NULL && replay_open(replay_file) != 0) {
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-    if (opt_verbose) {
-        printf("Starting thread for device %s\n", wire->device);
+    if (registry_init(registry_file) != 0) {
+        fprintf(stderr, "Could not load sensor registry %s\n", registry_file);
+        return_main = -1;
+        goto EXIT_MAIN;
     }
 
-    int collect_status = 0;
-    
-    if (wire->status == TEMP_STATUS_OK) {
-        if (opt_address_query_period > 0 && (current_uptime - wire->last_query >= opt_address_query_period)) {
-            collect_status = collect_thermometers(wire);
-            wire->last_query = current_uptime;
-        }
-    } else {
-        collect_status = init_wire(wire);
-        
-        if (collect_status != 0) {
-            goto EXIT_THREAD;
-        }
+    /* Before the MQTT client is created, to subscribe to requests */
+    if (query_open(read_socket, opt_mqtt_read, wire_count, wake_workers, read_now) != 0) {
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-        collect_status = collect_thermometers(wire);
-        wire->last_query = current_uptime;
+    if (open_sinks() != 0) {
+        return_main = -4;
+        goto EXIT_MAIN;
     }
 
-    if (collect_status != 0) {
-        goto EXIT_THREAD;
+    if (alert_open(alert_file, alert_socket, mqtt_server != NULL) != 0) {
+        return_main = -1;
+        goto EXIT_MAIN;
     }
 
-    int read_status = read_temperatures(wire);
+    if (snapshot_pool_init(sink_buffers_needed()) != 0) {
+        fprintf(stderr, "Could not allocate memory for snapshots\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-    if (read_status != 0) {
-        goto EXIT_THREAD;
+    if (sink_start_all() != 0) {
+        return_main = -1;
+        goto EXIT_MAIN;
     }
 
-    wire->tret = 0;
+    if (start_workers() != 0) {
+        fprintf(stderr, "Could not start threads for devices\n");
+        return_main = -1;
+        goto EXIT_MAIN;
+    }
 
-    pthread_exit(&wire->tret);
+    uint64_t next_cycle = time_mono_ns();
 
-    return NULL;
+    while (1) {
+        uint64_t now = time_mono_ns();
 
-EXIT_THREAD:
-    fprintf(stderr, "[%ld] Device %s failed, will be reinitialized.\n", current_uptime, wire->device);
+        if (now < next_cycle) {
+            time_sleep_ns(next_cycle - now);
+            continue;
+        }
 
-    if (wire->driver != NULL) {
-        release_driver(&wire->driver);
-        wire->driver = NULL;
-    }
-    
-    wire->status = TEMP_STATUS_FAIL;
-    wire->tret = -1;
+        current_uptime = now / NS_PER_S;
 
-    pthread_exit(&wire->tret);
+        uint64_t now_wall = time_wall_ns();
 
-    return NULL;
-}
+        /* Cycles keep to the period; a late cycle is not caught up, the next one is just due */
+        next_cycle += read_period_ns;
 
-static int init_wire(wire_t *wire)
-{
-    int drv_status;
+        if (next_cycle <= now) {
+            late_cycles += (now - next_cycle) / read_period_ns + 1;
+            next_cycle = now + read_period_ns;
+        }
 
-    drv_status = init_driver_linux_usart(&wire->driver, wire->device);
-    
-    if (drv_status != OW_OK) {
-        printf("Failed to init driver for %s\n", wire->device);
-        wire->driver = NULL;
-        return -2;
-    }
+        run_cycle(opt_deadline_ns > 0 ? now + opt_deadline_ns : 0);
 
-    owu_init(&wire->onewire, wire->driver);
+        uint64_t cycle_ns = time_mono_ns() - now;
 
-    if (drv_status != OW_OK) {
-        // Clear the driver
-        release_driver(&wire->driver);
-        wire->driver = NULL;
-        
-        return -1;
-    }
+        cycle_count++;
+        cycle_sum += cycle_ns;
+        cycle_sq_sum += (double) cycle_ns * cycle_ns;
 
-    wire->status = TEMP_STATUS_OK;
+        if (cycle_ns > cycle_max) {
+            cycle_max = cycle_ns;
+        }
 
-    return 0;
-}
+        record_flush();
+        registry_flush();
 
-static void release_wires()
-{
-    for (int i = 0; i < wire_count; i++) {
-        if (wires[i].driver != NULL) {
-            release_driver(&wires[i].driver);
-            wires[i].driver = NULL;
-            wires[i].status = TEMP_STATUS_FAIL;
+        if (replay_finished()) {
+            log_info("[%ld] Replay finished.\n", current_uptime);
+            goto EXIT_MAIN;
         }
-    }
-}
 
-static int collect_thermometers(wire_t *wire) {
-    wire->thermo_count = 0;
+        if (!quiet_cycles) {
+            log_info("[%ld] Temperatures read.\n", current_uptime);
+        }
+
+        /* Ahead of the window, which skips the rest of the cycle until it closes */
+        if (opt_stats > 0 && current_uptime - stats_start >= opt_stats) {
+            if (stats_start > 0) {
+                printf("[%ld] Sink statistics:\n", current_uptime);
+                sink_report();
+                report_cycles();
+            }
+
+            stats_start = current_uptime;
+        }
+
+        if (opt_window > 0) {
+            if (window_start == 0) {
+                window_start = current_uptime;
+            }
+
+            /* Readings are only aggregated until the window closes */
+            if (current_uptime - window_start < opt_window) {
+                continue;
+            }
+
+            close_window();
+            window_start = current_uptime;
+        }
+
+        /* Sinks run on their own threads, acquisition only queues a copy */
+        temp_snapshot_t *snap = snapshot_take(wires, wire_count, current_uptime);
 
+        if (snap != NULL) {
+            snap->window = opt_window;
+            snap->ts_cycle = now;
+            snap->ts_wall = now_wall;
+            sink_publish(snap);
+            snapshot_release(snap);
+        } else {
+            log_limited(LOG_WARN, "[%ld] No free snapshot buffer, readings not published.\n", current_uptime);
+        }
+    }
+
+EXIT_MAIN:
     if (opt_verbose) {
-        printf("Starting search of sensors...\n");
+        printf("Exit temp_daemon\n");
+    }
+
+    stop_workers();
+
+    sink_stop_all(opt_verbose);
+
+    /* After MQTT is closed, so no more requests come */
+    query_close();
+
+    snapshot_pool_release();
+
+    release_wires();
+
+    record_close(opt_verbose);
+
+    alert_close();
+
+    log_close();
+
+    registry_release();
+
+    if (wires) {
+        for (int i = 0; i < wire_count; i++) {
+            if (wires[i].thermometers) {
+                free(wires[i].thermometers);
+            }
+
+            free(wires[i].moved);
+        }
+        free(wires);
+    }
+
+    return return_main;
+}
+
+static int start_workers()
+{
+    for (int i = 0; i < wire_count; i++) {
+        wires[i].cycle = 0;
+        wires[i].busy = 0;
+        wires[i].deadline = 0;
+        wires[i].overruns = 0;
+        wires[i].stalls = 0;
+        wires[i].shed = 0;
+        wires[i].shed_cycles = 0;
+        wires[i].shed_next = 0;
+        wires[i].cycle_shed = 0;
+        wires[i].read_ns = 0;
+        wires[i].query_seen = 0;
+
+        if (pthread_create(&wires[i].tid, NULL, temp_thread, (void *) &wires[i]) != 0) {
+            return -1;
+        }
+
+        workers_started++;
+    }
+
+    return 0;
+}
+
+/*
+ * Wake up all wire workers and wait until every one has read its sensors.
+ * Past the deadline workers give up by themselves, at the next bit or byte;
+ * one still not back shortly after is blocked in the driver and is kicked
+ * out of it.
+ */
+/*
+ * Sensors moved between wires change owner here, while no wire reads them;
+ * the wire that found a sensor only asks for it. The new owner sets its
+ * resolution in its next cycle.
+ */
+static void hand_over_moved()
+{
+    for (int i = 0; i < wire_count; i++) {
+        wire_t *wire = &wires[i];
+
+        for (int j = 0; j < wire->moved_count; j++) {
+            thermometer_t *thermo = wire->moved[j];
+
+            if (thermo->wire_num != wire->num) {
+                log_info("[%ld] Sensor " ADDR_FMT " moved to device %s\n", current_uptime,
+                    ADDR_ARGS(thermo->address), wire->device);
+
+                thermo->wire_num = wire->num;
+            }
+        }
+    }
+}
+
+static void run_cycle(uint64_t deadline)
+{
+    int kicked = 0;
+
+    pthread_mutex_lock(&cycle_lock);
+
+    hand_over_moved();
+
+    cycle_seq++;
+    cycle_running = wire_count;
+
+    for (int i = 0; i < wire_count; i++) {
+        wires[i].busy = 1;
+        wires[i].deadline = deadline;
+    }
+
+    pthread_cond_broadcast(&cycle_start);
+
+    uint64_t kick_at = deadline + DEADLINE_GRACE_NS;
+
+    while (cycle_running > 0) {
+        if (deadline == 0) {
+            pthread_cond_wait(&cycle_done, &cycle_lock);
+        } else if (deadline_wait(&cycle_done, &cycle_lock, kick_at) == ETIMEDOUT) {
+            /* A kick landing right before a blocking call starts is lost, so kick until they are out */
+            for (int i = 0; i < wire_count; i++) {
+                if (wires[i].busy) {
+                    wires[i].stalls += !kicked;
+                    deadline_kick(wires[i].tid);
+                }
+            }
+
+            kicked = 1;
+            kick_at += DEADLINE_GRACE_NS;
+        }
+    }
+
+    pthread_mutex_unlock(&cycle_lock);
+}
+
+static void stop_workers()
+{
+    pthread_mutex_lock(&cycle_lock);
+    cycle_stop = 1;
+    pthread_cond_broadcast(&cycle_start);
+    pthread_mutex_unlock(&cycle_lock);
+
+    for (int i = 0; i < workers_started; i++) {
+        pthread_join(wires[i].tid, NULL);
+    }
+
+    workers_started = 0;
+}
+
+void *temp_thread(void *wire_v)
+{
+    wire_t *wire = (wire_t *) wire_v;
+
+    log_debug("Starting thread for device %s\n", wire->device);
+
+    rt_thread_setup(wire->device, wire->num);
+
+    pthread_mutex_lock(&cycle_lock);
+
+    while (1) {
+        while (!cycle_stop && wire->cycle == cycle_seq && !query_waiting(wire)) {
+            pthread_cond_wait(&cycle_start, &cycle_lock);
+        }
+
+        if (cycle_stop) {
+            break;
+        }
+
+        /* On-demand reads between cycles, one at a time so a starting cycle does not wait for all */
+        if (wire->cycle == cycle_seq) {
+            pthread_mutex_unlock(&cycle_lock);
+            query_serve(wire);
+            pthread_mutex_lock(&cycle_lock);
+            continue;
+        }
+
+        wire->cycle = cycle_seq;
+        deadline_set(wire->deadline);
+        wire->cycle_shed = 0;
+        pthread_mutex_unlock(&cycle_lock);
+
+        wire->tret = wire_cycle(wire);
+
+        int overrun = deadline_cancelled();
+        int stalled = deadline_stalled();
+
+        /* Shed load for a while after a missed deadline */
+        if (overrun) {
+            wire->shed_cycles = SHED_CYCLES;
+        } else if (wire->shed_cycles > 0) {
+            wire->shed_cycles--;
+        }
+
+        deadline_set(0);
+
+        pthread_mutex_lock(&cycle_lock);
+
+        /* Stuck in a driver call past the deadline, open the adapter anew */
+        if (stalled && wire->status == TEMP_STATUS_OK) {
+            log_warn("[%ld] Device %s stalled, will be reinitialized.\n", current_uptime, wire->device);
+
+            release_driver(&wire->driver);
+            wire->driver = NULL;
+            wire->status = TEMP_STATUS_FAIL;
+        }
+
+        wire->busy = 0;
+        wire->overruns += overrun;
+        wire->shed += wire->cycle_shed;
+
+        if (--cycle_running == 0) {
+            pthread_cond_signal(&cycle_done);
+        }
+    }
+
+    pthread_mutex_unlock(&cycle_lock);
+
+    return NULL;
+}
+
+static void wake_workers()
+{
+    pthread_mutex_lock(&cycle_lock);
+    pthread_cond_broadcast(&cycle_start);
+    pthread_mutex_unlock(&cycle_lock);
+}
+
+/*
+ * On-demand read of one sensor, by its wire thread between cycles. Into a
+ * scratchpad of its own, so the reading of the cycle stays as it was.
+ */
+static int read_now(wire_t *wire, thermometer_t *thermo, float *temperature)
+{
+    uint8_t scratchpad[__SCR_LENGTH];
+
+    if (wire->status != TEMP_STATUS_OK || ds_convert_device(&wire->onewire, thermo->address) != OW_OK) {
+        return -1;
+    }
+
+    time_sleep_ns(family_conversion_ns(thermo->family, opt_resolution));
+
+    /* Always checked, nobody filters this reading */
+    for (int c = 0; c < 3; c++) {
+        if (ds_read_scratchpad(&wire->onewire, thermo->address, scratchpad) == OW_OK
+            && (uint8_t) owu_crc8(scratchpad, SCR_CRC) == scratchpad[SCR_CRC]) {
+            *temperature = thermo->family->convert(scratchpad);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int wire_cycle(wire_t *wire)
+{
+    __label__ EXIT_CYCLE;
+
+    int collect_status = 0;
+    
+    if (wire->status == TEMP_STATUS_OK) {
+        int shed_search = wire->shed_cycles > 0 && (opt_shed & SHED_SEARCH);
+
+        if (opt_address_query_period > 0 && (current_uptime - wire->last_query >= opt_address_query_period)
+            && !shed_search) {
+            collect_status = collect_thermometers(wire);
+            wire->last_query = current_uptime;
+        }
+    } else {
+        collect_status = init_wire(wire);
+        
+        if (collect_status != 0) {
+            goto EXIT_CYCLE;
+        }
+
+        collect_status = collect_thermometers(wire);
+        wire->last_query = current_uptime;
+    }
+
+    if (collect_status != 0) {
+        goto EXIT_CYCLE;
+    }
+
+    wire_take_moved(wire);
+
+    int read_status = read_temperatures(wire);
+
+    if (read_status != 0) {
+        goto EXIT_CYCLE;
+    }
+
+    return 0;
+
+EXIT_CYCLE:
+    log_limited_by(LOG_ERROR, wire->device, "[%ld] Device %s failed, will be reinitialized.\n", current_uptime,
+        wire->device);
+
+    if (wire->driver != NULL) {
+        release_driver(&wire->driver);
+        wire->driver = NULL;
+    }
+    
+    wire->status = TEMP_STATUS_FAIL;
+
+    return -1;
+}
+
+static int open_sinks()
+{
+    static char mqtt_args[256];
+
+    if (output_tsv != NULL && sink_add(&tsv_sink, output_tsv, opt_sink_queue, opt_sink_policy) != 0) {
+        return -1;
+    }
+
+    if (output_json != NULL && sink_add(&json_sink, output_json, opt_sink_queue, opt_sink_policy) != 0) {
+        return -1;
+    }
+
+    if (output_binary != NULL && sink_add(&binary_sink, output_binary, opt_sink_queue, opt_sink_policy) != 0) {
+        return -1;
+    }
+
+    if (unix_socket != NULL && sink_add(&unix_sink, unix_socket, opt_sink_queue, opt_sink_policy) != 0) {
+        return -1;
+    }
+
+    if (mqtt_server != NULL) {
+        /* Readings older than two publish periods are stale */
+        if (opt_mqtt_expiry < 0) {
+            opt_mqtt_expiry = 2 * ((opt_window > 0) ? opt_window : (opt_adaptive ? opt_read_max : opt_read_period));
+        }
+
+        mqtt_config(opt_mqtt5, opt_mqtt_expiry, opt_mqtt_binary);
+
+        snprintf(mqtt_args, sizeof(mqtt_args), "%s:%d/%s", mqtt_server, mqtt_port, mqtt_topic);
+
+        if (sink_add(&mqtt_sink, mqtt_args, opt_sink_queue, opt_sink_policy) != 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < ext_sink_count; i++) {
+        if (sink_load(ext_sinks[i], opt_sink_queue, opt_sink_policy) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int init_wire(wire_t *wire)
+{
+    int drv_status;
+
+    drv_status = init_driver_linux_usart(&wire->driver, wire->device);
+    
+    if (drv_status != OW_OK) {
+        log_limited_by(LOG_ERROR, wire->device, "Failed to init driver for %s\n", wire->device);
+        wire->driver = NULL;
+        return -2;
     }
 
+    owu_init(&wire->onewire, wire->driver);
+
+    if (drv_status != OW_OK) {
+        // Clear the driver
+        release_driver(&wire->driver);
+        wire->driver = NULL;
+        
+        return -1;
+    }
+
+    wire->status = TEMP_STATUS_OK;
+
+    return 0;
+}
+
+static void release_wires()
+{
+    for (int i = 0; i < wire_count; i++) {
+        if (wires[i].driver != NULL) {
+            release_driver(&wires[i].driver);
+            wires[i].driver = NULL;
+            wires[i].status = TEMP_STATUS_FAIL;
+        }
+    }
+}
+
+static int wire_move(wire_t *wire, thermometer_t *thermo)
+{
+    for (int i = 0; i < wire->moved_count; i++) {
+        if (wire->moved[i] == thermo) {
+            return 0;
+        }
+    }
+
+    if (wire->moved_count >= wire->moved_max) {
+        thermometer_t **moved = realloc(wire->moved, (wire->moved_max + THERMO_COUNT_STEP) * sizeof(thermometer_t *));
+
+        if (moved == NULL) {
+            return -1;
+        }
+
+        wire->moved = moved;
+        wire->moved_max += THERMO_COUNT_STEP;
+    }
+
+    wire->moved[wire->moved_count++] = thermo;
+
+    return 0;
+}
+
+/* Sensors handed over to the wire since its last cycle get their resolution set, the rest keep waiting */
+static void wire_take_moved(wire_t *wire)
+{
+    int waiting = 0;
+
+    for (int i = 0; i < wire->moved_count; i++) {
+        thermometer_t *thermo = wire->moved[i];
+
+        if (thermo->wire_num != wire->num) {
+            wire->moved[waiting++] = thermo;
+        } else if (opt_resolution > 0 && thermo->family->has_resolution) {
+            set_resolution(wire, thermo);
+        }
+    }
+
+    wire->moved_count = waiting;
+}
+
+static int collect_thermometers(wire_t *wire) {
+    uint8_t address[8];
+
+    wire->thermo_count = 0;
+
+    log_debug("Starting search of sensors...\n");
+
     owu_reset_search(&wire->onewire);
 
-    while(owu_search(&wire->onewire, wire->thermometers[wire->thermo_count].address)) {
-        if (opt_verbose) {
-            printf("  Found ");
-            print_address(wire->thermometers[wire->thermo_count].address);
-            printf(" @ %s\n", wire->device);
+    while(owu_search(&wire->onewire, address)) {
+        log_debug("  Found " ADDR_FMT " @ %s\n", ADDR_ARGS(address), wire->device);
+
+        const temp_family_t *family = family_get(address[0]);
+
+        if (family == NULL) {
+            log_debug("  Not a thermometer, skipped\n");
+
+            continue;
         }
 
+        /* Known sensors keep their id and state, e.g. read schedule */
+        int created;
+        thermometer_t *thermo = registry_get(address, &created);
+
+        if (thermo == NULL) {
+            return -1;
+        }
+
+        if (created) {
+            thermo->family = family;
+            schedule_init(thermo, current_uptime);
+            health_init(thermo);
+            filter_init(thermo);
+            aggregate_init(thermo);
+            alert_init(thermo);
+            integrity_init(thermo);
+
+            thermo->wire_num = wire->num;
+        }
+
+        if (thermo->wire_num == wire->num) {
+            if (opt_resolution > 0 && family->has_resolution) {
+                set_resolution(wire, thermo);
+            }
+        } else if (wire_move(wire, thermo) != 0) {
+            /* Another wire may be reading it right now, it is handed over between cycles */
+            return -1;
+        }
+
+        wire->thermometers[wire->thermo_count] = thermo;
         wire->thermo_count++;
      
         if (wire->thermo_count >= wire->thermo_max) {
-            if (opt_verbose) {
-                printf("Expanding memory for more sensors\n");
-            }
+            log_debug("Expanding memory for more sensors\n");
 
-            wire->thermometers = realloc(wire->thermometers, (wire->thermo_max + THERMO_COUNT_STEP) * sizeof(thermometer_t));
+            wire->thermometers = realloc(wire->thermometers, (wire->thermo_max + THERMO_COUNT_STEP) * sizeof(thermometer_t *));
 
             if (wire->thermometers == NULL) {
                 return -1;
@@ -479,107 +1496,403 @@ static int collect_thermometers(wire_t *wire) {
         }
     }
 
-    if (opt_verbose) {
-        printf("... search done.\n");
-    }
+    log_debug("... search done.\n");
 
     if (wire->thermo_count == 0) {
-        fprintf(stderr, "[%ld] Could not find sensors on device %s\n", current_uptime, wire->device);
+        log_limited_by(LOG_ERROR, wire->device, "[%ld] Could not find sensors on device %s\n", current_uptime,
+            wire->device);
         
         return -2;
     }
 
-    printf("[%ld] Collected %d sensors on device %s\n", current_uptime, wire->thermo_count, wire->device);
+    log_info("[%ld] Collected %d sensors on device %s\n", current_uptime, wire->thermo_count, wire->device);
 
     return 0;
 }
 
+static int sensor_due(wire_t *wire, thermometer_t *thermo)
+{
+    /* Sensor moved to another wire is read there, until this one is searched again */
+    if (thermo->wire_num != wire->num) {
+        return 0;
+    }
+
+    return health_available(thermo, current_uptime) && schedule_due(thermo, current_uptime);
+}
+
+/* Reads the whole scratchpad, retried on CRC errors when checked; adds the count of CRC errors to `crc_errors` */
+static int read_scratchpad(wire_t *wire, thermometer_t *thermo, int check_crc, uint8_t attempts, int *crc_errors)
+{
+    int read_status = OW_ERR;
+    char rom[ADDR_TEXT_SIZE];
+
+    for (uint8_t c = 0; c < attempts; c++) {
+        read_status = ds_read_scratchpad(
+            &wire->onewire, 
+            thermo->address,
+            thermo->scratchpad
+        );
+
+        if (check_crc) {
+            uint32_t crc8 = owu_crc8(thermo->scratchpad, SCR_CRC);
+            
+            if ((uint8_t) crc8 == thermo->scratchpad[SCR_CRC]) {
+                log_debug("CRC check OK\n");
+                break;
+            } else {
+                health_crc_error(thermo);
+                atomic_fetch_add_explicit(&crc_error_count, 1, memory_order_relaxed);
+                (*crc_errors)++;
+
+                log_limited_by(LOG_DEBUG, addr_text(thermo->address, rom),
+                    "Encountered crc error: %d, %d, read status: %d\n", crc8, thermo->scratchpad[SCR_CRC], read_status);
+
+                read_status = OW_ERR; // A workaround to indicate reading failure.
+            }
+        }
+    }
+
+    return read_status;
+}
+
 static int read_temperatures(wire_t *wire)
 {
-    if (opt_verbose) {
-        printf("Start conversion @ %s\n", wire->device);
+    int due_count = 0;
+    uint64_t conversion_ns = 0;
+    char rom[ADDR_TEXT_SIZE];
+
+    for (int i = 0; i < wire->thermo_count; i++) {
+        thermometer_t *thermo = wire->thermometers[i];
+
+        if (sensor_due(wire, thermo)) {
+            uint64_t c_ns = family_conversion_ns(thermo->family, opt_resolution);
+
+            if (c_ns > conversion_ns) {
+                conversion_ns = c_ns;
+            }
+
+            due_count++;
+        }
+    }
+
+    if (due_count == 0) {
+        log_debug("No sensors due @ %s\n", wire->device);
+
+        return 0;
+    }
+
+    /* Conversion would not be done in time, leave the bus alone this cycle */
+    if (!record_deadline_allows(wire->driver, conversion_ns)) {
+        if (opt_deadline_ns > 0 && conversion_ns >= opt_deadline_ns) {
+            log_limited_by(LOG_WARN, wire->device,
+                "[%ld] Conversion of %.0f ms never fits the deadline @ %s, sensors not read\n", current_uptime,
+                (double) conversion_ns / NS_PER_MS, wire->device);
+        }
+
+        wire->cycle_shed += due_count;
+        return 0;
+    }
+
+    log_debug("Start conversion of %d sensors @ %s\n", due_count, wire->device);
+
+    int convert_status = OW_OK;
+
+    if (due_count == wire->thermo_count) {
+        uint64_t ts_convert = time_mono_ns();
+
+        convert_status = ds_convert_all(&wire->onewire);
+
+        for (int i = 0; i < wire->thermo_count; i++) {
+            if (wire->thermometers[i]->wire_num == wire->num) {
+                wire->thermometers[i]->ts_convert = ts_convert;
+            }
+        }
+    } else {
+        /* Address only the due sensors, the rest keep their last reading */
+        for (int i = 0; i < wire->thermo_count && convert_status == OW_OK; i++) {
+            if (sensor_due(wire, wire->thermometers[i])) {
+                wire->thermometers[i]->ts_convert = time_mono_ns();
+                convert_status = ds_convert_device(&wire->onewire, wire->thermometers[i]->address);
+            }
+        }
     }
-    int convert_status = ds_convert_all(&wire->onewire);
 
     if (convert_status != OW_OK) {
-        printf("Convert: no sensors @ %s\n", wires->device);
+        if (deadline_cancelled()) {
+            wire->cycle_shed += due_count;
+            return 0;
+        }
+
+        log_limited_by(LOG_ERROR, wire->device, "Convert: no sensors @ %s\n", wire->device);
         return -1;
     }
 
-    sleep(1);
+    /* Wait for the slowest of the due sensors; replayed ones have converted long ago */
+    if (!replay_active()) {
+        time_sleep_ns(conversion_ns);
+    }
 
-    int ret_val = 0;
+    int read_count = 0;
+    int shed_due = wire->shed_cycles > 0 && (opt_shed & SHED_DUE);
+    int shed_crc = wire->shed_cycles > 0 && (opt_shed & SHED_CRC);
 
-    for (int i = 0; i < wire->thermo_count; i++) {
+    /* While shedding, reads start from the sensors left out last cycle */
+    int first = shed_due ? wire->shed_next % wire->thermo_count : 0;
+
+    for (int n = 0; n < wire->thermo_count; n++) {
+        int i = (first + n) % wire->thermo_count;
         int read_status = OW_ERR;
+        thermometer_t *thermo = wire->thermometers[i];
 
-        if (opt_full_scratchpad) {
+        if (!sensor_due(wire, thermo)) {
+            continue;
+        }
 
-            uint8_t c;
+        if (!record_deadline_allows(wire->driver, shed_due ? wire->read_ns : 0)) {
+            /* Out of time, the rest is read next cycle */
+            for (int k = n; k < wire->thermo_count; k++) {
+                wire->cycle_shed += sensor_due(wire, wire->thermometers[(first + k) % wire->thermo_count]);
+            }
 
-            for (c = 0; c < ((opt_check_crc) ? 3 : 1); c++) {
-                read_status = ds_read_scratchpad(
-                    &wire->onewire, 
-                    wire->thermometers[i].address,
-                    wire->thermometers[i].scratchpad
-                );
+            wire->shed_next = i;
+            break;
+        }
 
-                if (opt_check_crc) {
-                    uint32_t crc8 = owu_crc8(wire->thermometers[i].scratchpad, SCR_CRC);
-                    
-                    if ((uint8_t) crc8 == wire->thermometers[i].scratchpad[SCR_CRC]) {
-                        if (opt_verbose) {
-                            printf("CRC check OK\n");
-                        }
-                        
-                        break;
-                    } else {
-                        fprintf(stderr, "Encountered crc error: %d, %d, read status: %d\n",
-                            crc8, wire->thermometers[i].scratchpad[SCR_CRC], read_status);
-                        
-                        read_status = OW_ERR; // A workaround to indicate reading failure.
-                    }
-                }
+        uint64_t read_start = time_mono_ns();
+        int crc_errors = 0; // Of all attempts, they count as one error of this read
+
+        /* Read the whole scratchpad only if asked to or if sensor's family needs it */
+        int full = opt_full_scratchpad || thermo->family->read_length > SCR_H + 1;
+        int check_crc = opt_check_crc;
+
+        /* Adaptively, whatever is read in full is CRC checked, and so is a sensor with recent errors */
+        if (opt_crc_adaptive) {
+            int reasons = full ? 0 : integrity_escalated(thermo);
+
+            if (reasons != 0) {
+                thermo->escalations++;
+                atomic_fetch_add_explicit(&escalation_count, 1, memory_order_relaxed);
+
+                log_debug("Recent errors @ " ADDR_FMT " (0x%02x), reading in full\n",
+                    ADDR_ARGS(thermo->address), reasons);
+
+                full = 1;
             }
+
+            check_crc = full;
+        }
+
+        /* Do not spend retries on a sensor which already keeps failing, nor when short of time */
+        uint8_t attempts = (check_crc && thermo->fail_streak == 0 && !shed_crc) ? 3 : 1;
+
+        if (full) {
+            read_status = read_scratchpad(wire, thermo, check_crc, attempts, &crc_errors);
         } else {
             read_status = ds_read_temp_only(
                 &wire->onewire, 
-                wire->thermometers[i].address,
-                wire->thermometers[i].scratchpad
+                thermo->address,
+                thermo->scratchpad
             );
+
+            /* A suspect quick read is done again in full, CRC checked */
+            int reasons = (read_status == OW_OK && opt_crc_adaptive)
+                ? integrity_suspect(thermo, thermo->family->convert(thermo->scratchpad)) : 0;
+
+            if (reasons != 0) {
+                thermo->escalations++;
+                atomic_fetch_add_explicit(&escalation_count, 1, memory_order_relaxed);
+
+                log_debug("Suspect reading @ " ADDR_FMT " (0x%02x), reading in full\n",
+                    ADDR_ARGS(thermo->address), reasons);
+
+                attempts = (thermo->fail_streak == 0 && !shed_crc) ? 3 : 1;
+                read_status = read_scratchpad(wire, thermo, 1, attempts, &crc_errors);
+            }
+        }
+
+        if (read_status != OW_OK && deadline_cancelled()) {
+            /* Cancelled, not the sensor's fault; it is read first next cycle */
+            wire->cycle_shed++;
+            wire->shed_next = i;
+            break;
         }
 
         if (read_status == OW_OK) {
-            wire->thermometers[i].temperature = ds_get_temp_c(wire->thermometers[i].scratchpad);
+            thermo->ts_read = time_mono_ns();
+            thermo->ts_wall = time_wall_ns();
+
+            /* Average read time, to tell whether another read fits before the deadline */
+            uint64_t read_ns = thermo->ts_read - read_start;
+            wire->read_ns = (wire->read_ns == 0) ? read_ns : (wire->read_ns * 7 + read_ns) / 8;
+
+            float value = thermo->family->convert(thermo->scratchpad);
+            int filtered = filter_apply(thermo, value);
+
+            integrity_good(thermo, value, crc_errors);
 
-            if (opt_verbose) {
-                printf("Temperature @ ");
-                print_address(wire->thermometers[i].address);
-                printf(": %.5f\n", wire->thermometers[i].temperature);
+            if (filtered == FILTER_REJECTED) {
+                log_debug("Rejected reading @ " ADDR_FMT ": %.5f\n", ADDR_ARGS(thermo->address), value);
+            } else {
+                log_debug("Temperature @ " ADDR_FMT ": %.5f\n", ADDR_ARGS(thermo->address), thermo->temperature);
             }
 
-            wire->thermometers[i].status = TEMP_STATUS_OK;
-        } else {
-            printf("Error reading sensor ");
-            print_address(wire->thermometers[i].address);
-            printf("\n");
+            /* Until the first accepted reading there is nothing to report */
+            if (filtered == FILTER_ACCEPTED) {
+                aggregate_add(thermo, thermo->temperature);
+                alert_check(thermo);
+            }
+
+            if (filtered == FILTER_ACCEPTED || thermo->filter_count > 0) {
+                thermo->status = TEMP_STATUS_OK;
+            } else {
+                thermo->status = TEMP_STATUS_FAIL;
+            }
+
+            schedule_update(thermo, current_uptime);
+
+            int streak = health_ok(thermo, current_uptime);
 
-            wire->thermometers[i].status = TEMP_STATUS_FAIL;
+            if (streak > 0) {
+                log_info("[%ld] Sensor " ADDR_FMT " recovered after %d failures\n",
+                    current_uptime, ADDR_ARGS(thermo->address), streak);
+            }
 
-            ret_val = -2;
+            read_count++;
+        } else {
+            thermo->status = TEMP_STATUS_FAIL;
+            integrity_error(thermo);
+
+            /* Report only the first failure and quarantine, not every cycle */
+            if (health_fail(thermo, current_uptime)) {
+                log_warn("[%ld] Sensor " ADDR_FMT " failed %d times in a row, quarantined for %ld s\n",
+                    current_uptime, ADDR_ARGS(thermo->address),
+                    thermo->fail_streak, thermo->quarantine_until - current_uptime);
+            } else if (thermo->fail_streak == 1) {
+                log_limited_by(LOG_WARN, addr_text(thermo->address, rom), "Error reading sensor " ADDR_FMT "\n",
+                    ADDR_ARGS(thermo->address));
+            }
         }
     }
 
-    printf("[%ld] Read %d sensors on device %s\n", current_uptime, wire->thermo_count, wire->device);
+    /*
+     * Reinitialize the line only when none of its sensors reads: not when the due ones failed while
+     * others, not due this cycle (adaptive reading, quarantine), read fine last time, nor when cancelled
+     */
+    int line_ok = read_count > 0 || deadline_cancelled();
+
+    for (int i = 0; i < wire->thermo_count && !line_ok; i++) {
+        thermometer_t *thermo = wire->thermometers[i];
+
+        line_ok = (thermo->wire_num == wire->num && thermo->fail_streak == 0);
+    }
+
+    int ret_val = line_ok ? 0 : -2;
+
+    if (!quiet_cycles) {
+        log_info("[%ld] Read %d of %d sensors on device %s\n", current_uptime, read_count, wire->thermo_count, wire->device);
+    }
 
     return ret_val;
 }
 
-static void print_address(uint8_t *addr) {
-    printf("%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-        addr[0], addr[1], addr[2], addr[3],
-        addr[4], addr[5], addr[6], addr[7]
-    );
+/*
+ * Move running aggregates of all sensors to the published ones. Called with
+ * wire threads joined.
+ */
+static void close_window()
+{
+    for (int i = 0; i < wire_count; i++) {
+        for (int j = 0; j < wires[i].thermo_count; j++) {
+            thermometer_t *thermo = wires[i].thermometers[j];
+
+            if (thermo->wire_num == wires[i].num) {
+                aggregate_close(thermo);
+            }
+        }
+    }
+}
+
+/* Read cycle duration, CRC errors and missed deadlines since the last report, to tell how steady the wires run */
+static void report_cycles()
+{
+    unsigned long crc_errors = atomic_exchange_explicit(&crc_error_count, 0, memory_order_relaxed);
+    unsigned long escalations = atomic_exchange_explicit(&escalation_count, 0, memory_order_relaxed);
+
+    if (cycle_count > 0) {
+        double mean = cycle_sum / cycle_count;
+        double variance = cycle_sq_sum / cycle_count - mean * mean;
+
+        printf("Read cycles: %lu, avg %.1f ms, max %.1f ms, stddev %.1f ms, %lu CRC errors\n",
+            cycle_count, mean / NS_PER_MS, (double) cycle_max / NS_PER_MS,
+            sqrt(variance > 0 ? variance : 0) / NS_PER_MS, crc_errors);
+    }
+
+    if (opt_crc_adaptive) {
+        printf("Reads checked in full as suspect or after errors: %lu\n", escalations);
+    }
+
+    /* Cycles run late, too short a period or deadlines missed */
+    printf("Cycles skipped: %lu\n", late_cycles);
+
+    if (opt_deadline_ns > 0) {
+        pthread_mutex_lock(&cycle_lock);
+
+        for (int i = 0; i < wire_count; i++) {
+            printf("Device %s: %lu deadlines missed, %lu stalls, %lu sensor reads shed\n",
+                wires[i].device, wires[i].overruns, wires[i].stalls, wires[i].shed);
+
+            wires[i].overruns = 0;
+            wires[i].stalls = 0;
+            wires[i].shed = 0;
+        }
+
+        pthread_mutex_unlock(&cycle_lock);
+    }
+
+    late_cycles = 0;
+    cycle_count = 0;
+    cycle_sum = 0;
+    cycle_sq_sum = 0;
+    cycle_max = 0;
+}
+
+/*
+ * Resolution is set right after the search, as sensors lose it on power
+ * loss. Alarm bytes are written back as they are, so the scratchpad must be
+ * read correctly first.
+ */
+static void set_resolution(wire_t *wire, thermometer_t *thermo)
+{
+    int status = ds_read_scratchpad(&wire->onewire, thermo->address, thermo->scratchpad);
+    char rom[ADDR_TEXT_SIZE];
+
+    if (status == OW_OK && (uint8_t) owu_crc8(thermo->scratchpad, SCR_CRC) != thermo->scratchpad[SCR_CRC]) {
+        health_crc_error(thermo);
+        atomic_fetch_add_explicit(&crc_error_count, 1, memory_order_relaxed);
+        status = OW_ERR;
+    }
+
+    if (status == OW_OK) {
+        status = family_set_resolution(wire->driver, thermo->address, thermo->scratchpad, opt_resolution);
+    }
+
+    if (status != OW_OK) {
+        log_limited_by(LOG_WARN, addr_text(thermo->address, rom),
+            "[%ld] Could not set resolution of sensor " ADDR_FMT "\n", current_uptime, ADDR_ARGS(thermo->address));
+    }
+}
+
+static int parse_log_level(const char *name)
+{
+    static const char *levels[] = { "error", "warn", "info", "debug" };
+
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, levels[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
 }
 
 static int create_daemon()
@@ -601,6 +1914,37 @@ static int create_daemon()
     return 0;
 }
 
+static int parse_shed(const char *list)
+{
+    opt_shed = 0;
+
+    if (strcmp(list, "none") == 0) {
+        return 0;
+    }
+
+    while (*list) {
+        size_t len = strcspn(list, ",");
+
+        if (len == 6 && strncmp(list, "search", len) == 0) {
+            opt_shed |= SHED_SEARCH;
+        } else if (len == 3 && strncmp(list, "crc", len) == 0) {
+            opt_shed |= SHED_CRC;
+        } else if (len == 3 && strncmp(list, "due", len) == 0) {
+            opt_shed |= SHED_DUE;
+        } else {
+            return -1;
+        }
+
+        list += len;
+
+        if (*list == ',') {
+            list++;
+        }
+    }
+
+    return 0;
+}
+
 void usage()
 {
     printf(
@@ -613,27 +1957,124 @@ void usage()
         "                                    E.g. temp_daemon -d /dev/ttyUSB0 -d /dev/ttyACM1\n"
         "  -c, --crc8                        Check CRC8 of the sensor. Automatically enables full scratchpad reading.\n"
         "                                    Useful in very noisy environments. Retries reading 3 times, then leaves it.\n"
-        "  -m, --median                      Enable conversion and reading three times in a row and taking the median\n"
-        "                                    value for reporting. Useful in very noisy environments and helps with to\n"
-        "                                    to avoid erroneous reading of highly differing values. However, takes\n"
-        "                                    longer time for conversion (~3 s vs. ~1 s)."
+        "  --crc_adaptive                    Read only the 2 temperature bytes, unchecked, and read the whole scratchpad\n"
+        "                                    with CRC only when the value is suspect: the power-on 85 C, out of range or\n"
+        "                                    a jump from the last good value; or when the sensor had errors lately.\n"
+        "                                    Faster than -c where errors are rare. Families read in full are always\n"
+        "                                    checked.\n"
+        "  --crc_jump=<C>                    Change from the last good value which makes a reading suspect. Defaults\n"
+        "                                    to 5 C, 0 to not check jumps.\n"
+        "  -m, --median                      Report the median of the last readings of each sensor instead of the\n"
+        "                                    last one. Useful in very noisy environments and helps to avoid erroneous\n"
+        "                                    reading of highly differing values. Filters across read cycles, so takes\n"
+        "                                    no extra conversions. Power-on (85 C) and error (-127 C) values are\n"
+        "                                    rejected whenever any filtering is on.\n"
+        "  --median_window=<n>               Count of readings to take the median of, up to 9. Default 5.\n"
+        "  --spike=<C>                       Reject readings differing from the median by more than this. A change\n"
+        "                                    lasting over half of the window is accepted. Default 0 (off).\n"
+        "  --ema=<alpha>                     Smooth reported value by exponential moving average, weight of the new\n"
+        "                                    reading between 0 and 1. Default 0 (off).\n"
+        "  --window=<sec>                    Publish minimum, maximum, mean and last temperature of each sensor over\n"
+        "                                    the window instead of every reading. Read period sets sampling rate.\n"
+        "                                    Default 0 (off).\n"
         "  -q <sec>, --query_period=<sec>    Set period in seconds to search for DALLAS temperature sensors.\n"
         "                                    Set to 0 (zero) to search for sensors only once on startup\n"
         "                                    Default period is 300 s (5 min.).\n"
         "  -r <sec>, --read_period=<sec>     Set period in seconds to read temperature and print output.\n"
-        "                                    Default period is 60 s (1 min.).\n"
-        "  -F, --full_scratchpad             Read full scratchpad, all 9 bytes. By default only 2 first bytes are read,\n"
-        "                                    as that's enough to convert the temperature. A bit faster.\n"
+        "                                    Fractions are allowed, e.g. 0.125 for 8 Hz sampling of a few sensors\n"
+        "                                    together with --resolution=9. The period must fit the conversion and the\n"
+        "                                    reads, else cycles run late. Default period is 60 s (1 min.).\n"
+        "  --resolution=<bits>               Set resolution of DS18B20, DS1822 and DS1825 sensors to 9 to 12 bits and\n"
+        "                                    wait only as long as the conversion takes: 94, 188, 375 or 750 ms,\n"
+        "                                    plus 10%% margin.\n"
+        "                                    By default sensors keep their resolution and conversion takes 1 s.\n"
+        "  -F, --full_scratchpad             Read full scratchpad, all 9 bytes, of every sensor. By default only bytes\n"
+        "                                    needed by sensor's family are read: 2 first bytes of DS18B20, DS1822 and\n"
+        "                                    DS1825, as that's enough to convert the temperature, and full scratchpad\n"
+        "                                    of DS18S20.\n"
+        "\n"
+        "Adaptive reading options:\n"
+        "  -a, --adaptive                    Adapt read interval of each sensor to its rate of change: read often while\n"
+        "                                    temperature moves, back off while it is stable. Only the sensors which are\n"
+        "                                    due are converted and read, the read period becomes the starting interval.\n"
+        "  --read_min=<sec>                  Shortest read interval in adaptive mode. Default 10 s.\n"
+        "  --read_max=<sec>                  Longest read interval in adaptive mode. Default 600 s.\n"
+        "  --adapt_delta=<C>                 Temperature change to aim for between two reads. Default 0.25 C.\n"
         "\n"
         "Output options, can be used simultaneously:\n"
         "  --tsv=<file>                      Write output to TSV file.\n"
         "  --json=<file>                     Write output to JSON file.\n"
+        "  --binary=<file>                   Write output to binary file, see src/temp_binary.h for the format and\n"
+        "                                    tools/temp_decode to print it.\n"
         "  --mqtt_server=<server>            Send output to MQTT server.\n"
         "  --mqtt_port=<port>                Set MQTT server's port. Default 1883.\n"
         "  --mqtt_topic=<topic>              Set parent MQTT topic. Default \"darauble/temp_daemon\"\n"
+        "  --mqtt_binary                     Send all sensors in a single binary message to <topic>/batch instead of\n"
+        "                                    text messages to topics of every sensor. Same format as --binary.\n"
+        "  --mqtt5                           Connect with MQTT 5, falling back to 3.1.1 if the server refuses. Topics\n"
+        "                                    are sent in full once per connection and as topic aliases afterwards.\n"
+        "  --mqtt_expiry=<sec>               MQTT 5 expiry of per-sensor messages, 0 for none. Default twice the\n"
+        "                                    publish period.\n"
+        "  --sink=<file.so>[:<args>]         Load external output sink from shared object, can be given several times.\n"
+        "                                    Arguments are passed to the sink as they are.\n"
+        "  --sink_queue=[<name>=]<n>         Count of snapshots every sink can have queued. Default 2. With a name\n"
+        "                                    (tsv, json, binary, unix, mqtt or that of an external sink), only for\n"
+        "                                    that sink. Can be given several times.\n"
+        "  --sink_policy=[<name>=]<drop|block>\n"
+        "                                    When sink's queue is full, either drop the oldest snapshot (default) or\n"
+        "                                    make reading wait for the sink. With a name, only for that sink.\n"
+        "  --unix_socket=<path>              Send every reading as a datagram to Unix socket bound by the consumer.\n"
+        "                                    Binary records, see unix_record_t in temp_output.h. Never blocks.\n"
+        "  --stats=<sec>                     Every this many seconds print counters of every sink and the age of\n"
+        "                                    readings, from the read until written out by the sink. Default 0 (off).\n"
+        "  --registry=<file>                 Keep sensor ids and aliases in the file, so they are stable across restarts.\n"
+        "                                    Tab separated ROM, id and alias, aliases may be edited by hand.\n"
+        "\n"
+        "Real-time options, need CAP_SYS_NICE or root and enough RLIMIT_MEMLOCK:\n"
+        "  --sched=<fifo|rr>                 Run device threads under SCHED_FIFO or SCHED_RR, so other processes do\n"
+        "                                    not delay 1-Wire transactions. Default: normal scheduling.\n"
+        "  --sched_priority=<n>              Real-time priority of device threads. Default 10.\n"
+        "  --cpus=<list>                     Pin device threads to these CPUs, e.g. 3 or 2,3 or 1-3. Devices are\n"
+        "                                    assigned to listed CPUs in turn.\n"
+        "  --mlock                           Lock all memory of the daemon and pre-fault thread stacks, so no page\n"
+        "                                    faults happen while reading.\n"
+        "  With -v, what the kernel granted is printed for every device thread. Read cycle time and CRC errors\n"
+        "  are printed along with --stats.\n"
+        "\n"
+        "Alert options:\n"
+        "  --alerts=<file>                   Check every reading against rules of the file right as it is read, and\n"
+        "                                    send alerts to <topic>/alert of MQTT and to --alert_socket. One rule per\n"
+        "                                    line: <ROM|alias|*> <low C> <high C> <rate C/min> <hysteresis C>, - for\n"
+        "                                    no limit.\n"
+        "  --alert_socket=<path>             Send alerts as JSON datagrams to Unix socket bound by the consumer.\n"
+        "\n"
+        "On-demand read options:\n"
+        "  --read_socket=<path>              Bind a Unix datagram socket for on-demand reads. A datagram with a ROM\n"
+        "                                    or alias has the sensor converted and read right after the current\n"
+        "                                    read cycle, the result is sent back as JSON to the requester's address.\n"
+        "  --mqtt_read                       Take on-demand read requests from <topic>/read of MQTT too, results are\n"
+        "                                    published to <topic>/read/result.\n"
+        "\n"
+        "Deadline options:\n"
+        "  --deadline=<sec>                  Time every device has to read its sensors in a read cycle, at most the\n"
+        "                                    read period. Once it passes, the transaction in progress is abandoned\n"
+        "                                    and the cycle is published without the rest. Must be longer than the\n"
+        "                                    conversion. Default 0 (off).\n"
+        "  --shed=<list>                     What to give up for 10 cycles after a device missed its deadline,\n"
+        "                                    comma separated: search (postpone searching for sensors), crc (no CRC\n"
+        "                                    retries), due (read only sensors fitting before the deadline, the rest\n"
+        "                                    first next cycle), or none. Default search,crc,due.\n"
+        "\n"
+        "Testing options:\n"
+        "  --record=<file>                   Record all 1-Wire traffic of all devices, with timestamps, to the file.\n"
+        "  --replay=<file>                   Do not open devices, replay recorded traffic instead. Give the same\n"
+        "                                    devices and options as when recording. Exits when the recording ends.\n"
         "\n"
         "Other options:\n"
         "  -v, --verbose                     Print verbose output of daemon's actions.\n"
+        "  --log_level=<level>               Log error, warn, info or debug messages and above. Default info, debug\n"
+        "                                    with -v. Messages are written out by a thread of their own, repeated\n"
+        "                                    errors of the same kind at most 5 a minute.\n"
         "  -h, --help                        Print this usage message and exit.\n"
         "  --version                         Print application's version and exit.\n"
         "\n"
@@ -2,9 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "dallas.h"
 #include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_binary.h"
+
+#include <jansson.h>
 
 #include "MQTTAsync.h"
 
@@ -15,51 +23,157 @@
 #define TEMP_SCRATCHPAD_TOPIC TEMP_BASE_TOPIC "scratchpad"
 #define TEMP_TEMPERATURE_TOPIC TEMP_BASE_TOPIC "temperature"
 #define TEMP_INFO_TOPIC TEMP_BASE_TOPIC "info"
+#define TEMP_WINDOW_TOPIC TEMP_BASE_TOPIC "window"
 #define DEV_INFO_TOPIC "%s/device/%d"
+#define BATCH_TOPIC "%s/batch"
+#define ALERT_TOPIC "%s/alert"
+#define READ_TOPIC "%s/read"
+#define READ_RESULT_TOPIC "%s/read/result"
 
 #define TEMP_SCRATCHPAD_TPL "%02X%02X%02X%02X%02X%02X%02X%02X%02X"
 #define TEMP_TEMPERATURE_TPL "%.5f"
-#define TEMP_INFO_TPL "{\"num\":%d,\"device_num\":%d,\"status\":%d}"
+#define TEMP_WINDOW_TPL "{\"period\":%ld,\"min\":%.4f,\"max\":%.4f,\"mean\":%.4f,\"last\":%.4f,\"count\":%d}"
 #define DEV_INFO_TPL "{\"device\":\"%s\",\"status\":%d,\"thermo_count\":%d}"
 
+#define CONNACK_UNACCEPTABLE_VERSION 1 // Return code of MQTT 3.1.1 brokers to an MQTT 5 connect
+
 #define TOPIC_SIZE 256
-#define PAYLOAD_SIZE 64
+#define PAYLOAD_SIZE 384
+
+#define ALIAS_SLOTS 1024
+#define ALIAS_MAX (ALIAS_SLOTS / 2) // Table is kept at most half full
+
+typedef struct alias {
+    char *topic;
+    int alias;
+    atomic_ulong known; // Connection on which the broker has got the full topic with the alias, 0 if none
+} alias_t;
+
+/* Context of a message with the full topic and its alias, the alias is known once it is acknowledged */
+typedef struct alias_ack {
+    alias_t *alias;
+    unsigned long connection;
+} alias_ack_t;
 
 static char topic[TOPIC_SIZE];
 static char payload[PAYLOAD_SIZE];
 static char lwt_topic[TOPIC_SIZE];
 static char url[TOPIC_SIZE];
+static char server_arg[TOPIC_SIZE];
+static char topic_arg[TOPIC_SIZE];
 
 static MQTTAsync client;
 static char *main_topic;
 
+/* Alerts are published by wire threads, the client must not change under them */
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+static int client_open = 0;
+static char alert_topic[TOPIC_SIZE];
+
+/* On-demand read requests, see temp_query.h */
+static void (*read_handler)(const char *name, int len) = NULL;
+static char read_topic[TOPIC_SIZE];
+static char read_result_topic[TOPIC_SIZE];
+
+/* MQTT 5 */
+static int use_mqtt5 = 0;
+static long msg_expiry = 0;
+static int batch_binary = 0;
+static uint8_t *batch = NULL; // Binary encoded snapshot
+static size_t batch_size = 0;
+static int version = MQTTVERSION_DEFAULT; // Of the current client
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long connections = 0; // Successful connects and reconnects
+static int fallback = 0; // MQTT 5 refused, retry with 3.1.1
+static int alias_max = 0; // Topic aliases the broker accepts
+
+/* Topic aliases are per connection and only used by the sink thread */
+static alias_t aliases[ALIAS_SLOTS];
+static unsigned long alias_connection = 0;
+static int alias_count = 0;
+
 static void onConnect(void* context, MQTTAsync_successData* response);
 static void onConnectFailure(void* context, MQTTAsync_failureData* response);
+static void onConnect5(void* context, MQTTAsync_successData5* response);
+static void onConnectFailure5(void* context, MQTTAsync_failureData5* response);
+static void onConnected(void* context, char* cause);
+static int onMessage(void* context, char* topicName, int topicLen, MQTTAsync_message* message);
 static void onDisconnect(void* context, MQTTAsync_successData* response);
 static void onSend(void* context, MQTTAsync_successData* response);
 static void onSendFail(void* context, MQTTAsync_failureData* response);
+static void onSend5(void* context, MQTTAsync_successData5* response);
+static void onSendFail5(void* context, MQTTAsync_failureData5* response);
 static void connect(char *url);
+static void publish(const char *topic, const char *payload, int expires, const temp_reading_t *stamp);
+static void publish_data(const char *topic, const void *data, int len, int expires, const temp_reading_t *stamp);
+static void send_batch(const temp_snapshot_t *snap);
+static void aliases_clear();
 static void beautify_float_str(char *str);
+static int payload_json(json_t *json);
 
 #ifdef MQTT_WAIT_PUBLISHING
 static volatile int published = 0;
 #endif
 
+/*
+ * With `mqtt5` the client connects with MQTT 5 and falls back to 3.1.1 if
+ * the broker does not take it. Per-sensor messages then expire after
+ * `expiry` seconds (0 for never). With `binary` all sensors are sent in a
+ * single binary message (see temp_binary.h) instead of per-sensor topics.
+ */
+void mqtt_config(int mqtt5, long expiry, int binary)
+{
+    use_mqtt5 = mqtt5;
+    msg_expiry = expiry;
+    batch_binary = binary;
+}
+
 void mqtt_open(char *server, int port, char *topic_base)
 {
     main_topic = topic_base;
+    version = use_mqtt5 ? MQTTVERSION_5 : MQTTVERSION_DEFAULT;
 
     snprintf(url, TOPIC_SIZE, SERVER_PATTERN, server, port);
+    snprintf(alert_topic, TOPIC_SIZE, ALERT_TOPIC, main_topic);
+    snprintf(read_topic, TOPIC_SIZE, READ_TOPIC, main_topic);
+    snprintf(read_result_topic, TOPIC_SIZE, READ_RESULT_TOPIC, main_topic);
 
+    pthread_mutex_lock(&client_lock);
     connect(url);
+    client_open = 1;
+    pthread_mutex_unlock(&client_lock);
 }
 
 static void connect(char *lurl)
 {
-    MQTTAsync_create(&client, lurl, "temp_daemon", MQTTCLIENT_PERSISTENCE_NONE, NULL);
-
     MQTTAsync_willOptions will_opts = MQTTAsync_willOptions_initializer;
     MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+    MQTTAsync_connectOptions conn_opts5 = MQTTAsync_connectOptions_initializer5;
+
+    if (version == MQTTVERSION_5) {
+        MQTTAsync_createOptions create_opts = MQTTAsync_createOptions_initializer;
+        create_opts.MQTTVersion = MQTTVERSION_5;
+
+        MQTTAsync_createWithOptions(&client, lurl, "temp_daemon", MQTTCLIENT_PERSISTENCE_NONE, NULL, &create_opts);
+
+        conn_opts = conn_opts5;
+        conn_opts.MQTTVersion = MQTTVERSION_5;
+        conn_opts.cleanstart = 1;
+        conn_opts.onSuccess5 = onConnect5;
+        conn_opts.onFailure5 = onConnectFailure5;
+    } else {
+        MQTTAsync_create(&client, lurl, "temp_daemon", MQTTCLIENT_PERSISTENCE_NONE, NULL);
+
+        conn_opts.cleansession = 1;
+        conn_opts.onSuccess = onConnect;
+        conn_opts.onFailure = onConnectFailure;
+    }
+
+    MQTTAsync_setConnected(client, NULL, onConnected);
+
+    if (read_handler != NULL) {
+        MQTTAsync_setCallbacks(client, NULL, NULL, onMessage, NULL);
+    }
 
     snprintf(lwt_topic, TOPIC_SIZE, "%s/lwt", main_topic);
 
@@ -67,9 +181,6 @@ static void connect(char *lurl)
     conn_opts.minRetryInterval = 10;
     conn_opts.maxRetryInterval = 300;
     conn_opts.automaticReconnect = 1;
-    conn_opts.cleansession = 1;
-    conn_opts.onSuccess = onConnect;
-    conn_opts.onFailure = onConnectFailure;
     conn_opts.context = client;
     
     conn_opts.will = &will_opts;
@@ -80,119 +191,155 @@ static void connect(char *lurl)
     MQTTAsync_connect(client, &conn_opts);
 }
 
-void mqtt_send(wire_t *wires, int wire_count)
+void mqtt_send(const temp_snapshot_t *snap)
 {
-    int t = 0;
-
-    MQTTAsync_message msg = MQTTAsync_message_initializer;
-    msg.qos = 1;
-    msg.retained = 0;
-
-    MQTTAsync_responseOptions response;
-    response.onSuccess = onSend;
-    response.onFailure = onSendFail;
-    response.context = client;
+    pthread_mutex_lock(&conn_lock);
+    int retry = fallback;
+    fallback = 0;
+    pthread_mutex_unlock(&conn_lock);
+
+    if (retry) {
+        printf("MQTT 5 connection failed, falling back to MQTT 3.1.1\n");
+
+        pthread_mutex_lock(&client_lock);
+        MQTTAsync_destroy(&client);
+        version = MQTTVERSION_DEFAULT;
+        connect(url);
+        pthread_mutex_unlock(&client_lock);
+    }
 
     /** Resend LWT with each delivery, as if reconnect occurs, onConnect
      * is not called repeatedly! **/
-    msg.payload = "online";
-    msg.payloadlen = strlen(msg.payload);
-
-    MQTTAsync_sendMessage(client, lwt_topic, &msg, &response);
+    publish(lwt_topic, "online", 0, NULL);
 
-#ifdef MQTT_WAIT_PUBLISHING
-    struct timespec read_wait = { .tv_sec = 0, .tv_nsec = 100000 };
-#endif
-
-    for (int i = 0; i < wire_count; i++) {
+    for (int i = 0; i < snap->wire_count; i++) {
         /*** Send the device information ***/
         snprintf(topic, TOPIC_SIZE, DEV_INFO_TOPIC, main_topic, i);
 
         snprintf(payload, PAYLOAD_SIZE, DEV_INFO_TPL,
-            wires[i].device, wires[i].status, wires[i].thermo_count
+            snap->wires[i].device, snap->wires[i].status, snap->wires[i].thermo_count
         );
 
-        msg.payload = payload;
-        msg.payloadlen = strlen(payload);
-        
-        MQTTAsync_sendMessage(client, topic, &msg, &response);
+        publish(topic, payload, 0, NULL);
+    }
 
-#ifdef MQTT_WAIT_PUBLISHING
-        while (!published) nanosleep(&read_wait, NULL);
-        published = 0;
-#endif
+    if (batch_binary) {
+        send_batch(snap);
+        return;
+    }
 
-        for (int j = 0; j < wires[i].thermo_count; j++, t++) {
-            
-            uint8_t *addr = wires[i].thermometers[j].address;
-            uint8_t *scr = wires[i].thermometers[j].scratchpad;
+    for (int t = 0; t < snap->thermo_count; t++) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        const uint8_t *addr = thermo->address;
+        const uint8_t *scr = thermo->scratchpad;
 
-            /*** Send the scratchpad ***/
-            snprintf(topic, TOPIC_SIZE, TEMP_SCRATCHPAD_TOPIC,
-                main_topic,
-                addr[0], addr[1], addr[2], addr[3],
-                addr[4], addr[5], addr[6], addr[7]
-            );
+        /*** Send the scratchpad ***/
+        snprintf(topic, TOPIC_SIZE, TEMP_SCRATCHPAD_TOPIC,
+            main_topic,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7]
+        );
 
-            snprintf(payload, PAYLOAD_SIZE, TEMP_SCRATCHPAD_TPL,
-                scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
-                scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC]
-            );
+        snprintf(payload, PAYLOAD_SIZE, TEMP_SCRATCHPAD_TPL,
+            scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
+            scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC]
+        );
 
-            msg.payload = payload;
-            msg.payloadlen = strlen(payload);
-            
-            MQTTAsync_sendMessage(client, topic, &msg, &response);
+        publish(topic, payload, 1, thermo);
 
-#ifdef MQTT_WAIT_PUBLISHING
-            while (!published) nanosleep(&read_wait, NULL);
-            published = 0;
-#endif
+        /*** Send the temperature ***/
+        snprintf(topic, TOPIC_SIZE, TEMP_TEMPERATURE_TOPIC,
+            main_topic,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7]
+        );
+
+        snprintf(payload, PAYLOAD_SIZE, TEMP_TEMPERATURE_TPL,
+            thermo->temperature
+        );
 
-            /*** Send the temperature ***/
-            snprintf(topic, TOPIC_SIZE, TEMP_TEMPERATURE_TOPIC,
-                main_topic,
-                addr[0], addr[1], addr[2], addr[3],
-                addr[4], addr[5], addr[6], addr[7]
-            );
+        beautify_float_str(payload);
 
-            snprintf(payload, PAYLOAD_SIZE, TEMP_TEMPERATURE_TPL,
-                wires[i].thermometers[j].temperature
-            );
+        publish(topic, payload, 1, thermo);
 
-            beautify_float_str(payload);
+        /*** Send the other information ***/
+        snprintf(topic, TOPIC_SIZE, TEMP_INFO_TOPIC,
+            main_topic,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7]
+        );
 
-            msg.payload = payload;
-            msg.payloadlen = strlen(payload);
-            
-            MQTTAsync_sendMessage(client, topic, &msg, &response);
+        /* Strings are escaped by jansson, as in the JSON file output */
+        json_t *jinfo = json_object();
+
+        json_object_set_new(jinfo, "num", json_integer(t));
+        json_object_set_new(jinfo, "id", json_integer(thermo->id));
+        json_object_set_new(jinfo, "alias", json_string((thermo->alias != NULL) ? thermo->alias : ""));
+        json_object_set_new(jinfo, "family", json_string(thermo->family));
+        json_object_set_new(jinfo, "device_num", json_integer(thermo->wire_num));
+        json_object_set_new(jinfo, "status", json_integer(thermo->status));
+        json_object_set_new(jinfo, "crc_errors", json_integer(thermo->crc_errors));
+        json_object_set_new(jinfo, "read_errors", json_integer(thermo->read_errors));
+        json_object_set_new(jinfo, "fail_streak", json_integer(thermo->fail_streak));
+        json_object_set_new(jinfo, "last_good", json_integer(thermo->last_good));
+        json_object_set_new(jinfo, "quarantine_until", json_integer(thermo->quarantine_until));
+        json_object_set_new(jinfo, "spikes", json_integer(thermo->spikes));
+        json_object_set_new(jinfo, "ts_convert", json_integer(thermo->ts_convert));
+        json_object_set_new(jinfo, "ts_read", json_integer(thermo->ts_read));
+        json_object_set_new(jinfo, "ts_wall", json_integer(thermo->ts_wall));
+
+        if (payload_json(jinfo) == 0) {
+            publish(topic, payload, 1, NULL);
+        } else {
+            fprintf(stderr, "Info of sensor %d does not fit into MQTT payload, not sent\n", t);
+        }
 
-#ifdef MQTT_WAIT_PUBLISHING
-            while (!published) nanosleep(&read_wait, NULL);
-            published = 0;
-#endif
+        if (snap->window == 0 || thermo->win_count == 0) {
+            continue;
+        }
 
-            /*** Send the other information ***/
-            snprintf(topic, TOPIC_SIZE, TEMP_INFO_TOPIC,
-                main_topic,
-                addr[0], addr[1], addr[2], addr[3],
-                addr[4], addr[5], addr[6], addr[7]
-            );
-
-            snprintf(payload, PAYLOAD_SIZE, TEMP_INFO_TPL,
-                t, i, wires[i].thermometers[j].status
-            );
-
-            msg.payload = payload;
-            msg.payloadlen = strlen(payload);
-            
-            MQTTAsync_sendMessage(client, topic, &msg, &response);
-#ifdef MQTT_WAIT_PUBLISHING
-            while (!published) nanosleep(&read_wait, NULL);
-            published = 0;
-#endif
+        /*** Send the window aggregates ***/
+        snprintf(topic, TOPIC_SIZE, TEMP_WINDOW_TOPIC,
+            main_topic,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7]
+        );
+
+        snprintf(payload, PAYLOAD_SIZE, TEMP_WINDOW_TPL,
+            snap->window, thermo->win_min, thermo->win_max,
+            thermo->win_mean, thermo->win_last, thermo->win_count
+        );
+
+        publish(topic, payload, 1, thermo);
+    }
+}
+
+/* All sensors in one message, no text formatting at all */
+static void send_batch(const temp_snapshot_t *snap)
+{
+    size_t len = binary_size(snap->thermo_count);
+
+    if (len > batch_size) {
+        uint8_t *b = realloc(batch, len);
+
+        if (b == NULL) {
+            fprintf(stderr, "Cannot allocate memory for MQTT batch\n");
+            return;
         }
+
+        batch = b;
+        batch_size = len;
+    }
+
+    len = binary_encode(snap, batch, batch_size);
+
+    if (len == 0) {
+        return;
     }
+
+    snprintf(topic, TOPIC_SIZE, BATCH_TOPIC, main_topic);
+
+    publish_data(topic, batch, len, 1, NULL);
 }
 
 void mqtt_close()
@@ -200,7 +347,217 @@ void mqtt_close()
     MQTTAsync_disconnectOptions opts = MQTTAsync_disconnectOptions_initializer;
     opts.onSuccess = onDisconnect;
     opts.context = client;
+
+    pthread_mutex_lock(&client_lock);
+    client_open = 0;
     MQTTAsync_disconnect(client, &opts);
+    pthread_mutex_unlock(&client_lock);
+
+    aliases_clear();
+
+    free(batch);
+    batch = NULL;
+    batch_size = 0;
+}
+
+/*
+ * Publish right away, from a wire thread. Topic aliases belong to the sink
+ * thread, so these go with the full topic.
+ */
+static void publish_now(const char *topic, const char *payload)
+{
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+    msg.payload = (void *) payload;
+    msg.payloadlen = strlen(payload);
+    msg.qos = 1;
+    msg.retained = 0;
+
+    pthread_mutex_lock(&client_lock);
+
+    if (client_open) {
+        MQTTAsync_sendMessage(client, topic, &msg, NULL);
+    }
+
+    pthread_mutex_unlock(&client_lock);
+}
+
+/* Publish an alert right away, from the wire thread which raised it */
+void mqtt_alert(const char *alert)
+{
+    publish_now(alert_topic, alert);
+}
+
+/* Subscribe to <topic>/read and pass the payload of requests to `handler`; before mqtt_open() */
+void mqtt_on_read(void (*handler)(const char *name, int len))
+{
+    read_handler = handler;
+}
+
+void mqtt_read_result(const char *result)
+{
+    publish_now(read_result_topic, result);
+}
+
+/*
+ * Find or assign alias of the topic for the current connection, NULL if
+ * the broker allows no more of them.
+ */
+static alias_t *topic_alias(const char *topic)
+{
+    pthread_mutex_lock(&conn_lock);
+    unsigned long conn = connections;
+    int max = alias_max;
+    pthread_mutex_unlock(&conn_lock);
+
+    /* Aliases of the previous connection are gone */
+    if (conn != alias_connection) {
+        aliases_clear();
+        alias_connection = conn;
+    }
+
+    uint32_t h = 2166136261u;
+
+    for (const char *c = topic; *c; c++) {
+        h = (h ^ (uint8_t) *c) * 16777619u;
+    }
+
+    for (int i = 0; i < ALIAS_SLOTS; i++) {
+        alias_t *a = &aliases[(h + i) % ALIAS_SLOTS];
+
+        if (a->topic == NULL) {
+            if (alias_count >= max || alias_count >= ALIAS_MAX) {
+                return NULL;
+            }
+
+            a->topic = malloc(strlen(topic) + 1);
+
+            if (a->topic == NULL) {
+                return NULL;
+            }
+
+            strcpy(a->topic, topic);
+            a->alias = ++alias_count;
+            atomic_store(&a->known, 0);
+
+            return a;
+        }
+
+        if (strcmp(a->topic, topic) == 0) {
+            return a;
+        }
+    }
+
+    return NULL;
+}
+
+static void aliases_clear()
+{
+    for (int i = 0; i < ALIAS_SLOTS; i++) {
+        free(aliases[i].topic);
+        aliases[i].topic = NULL;
+    }
+
+    alias_count = 0;
+}
+
+static void add_user_property(MQTTProperties *props, const char *name, uint64_t value)
+{
+    char value_str[24];
+    MQTTProperty prop;
+
+    snprintf(value_str, sizeof(value_str), "%" PRIu64, value);
+
+    prop.identifier = MQTTPROPERTY_CODE_USER_PROPERTY;
+    prop.value.data.data = (char *) name;
+    prop.value.data.len = strlen(name);
+    prop.value.value.data = value_str;
+    prop.value.value.len = strlen(value_str);
+
+    MQTTProperties_add(props, &prop);
+}
+
+/*
+ * Publish one message. Over MQTT 5 the topic is sent in full only the first
+ * time on a connection, an alias afterwards; messages which `expire` get
+ * the expiry interval and readings are `stamp`ed with their read time.
+ */
+static void publish(const char *topic, const char *payload, int expires, const temp_reading_t *stamp)
+{
+    publish_data(topic, payload, strlen(payload), expires, stamp);
+}
+
+static void publish_data(const char *topic, const void *data, int len, int expires, const temp_reading_t *stamp)
+{
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+    msg.payload = (void *) data;
+    msg.payloadlen = len;
+    msg.qos = 1;
+    msg.retained = 0;
+
+    MQTTAsync_responseOptions response = MQTTAsync_responseOptions_initializer;
+    response.context = client;
+
+#ifdef MQTT_WAIT_PUBLISHING
+    struct timespec read_wait = { .tv_sec = 0, .tv_nsec = 100000 };
+#endif
+
+    int rc;
+
+    if (version == MQTTVERSION_5) {
+        MQTTProperty prop;
+        const char *destination = topic;
+        alias_t *alias = topic_alias(topic);
+        alias_ack_t *ack = NULL;
+
+        response.onSuccess5 = onSend5;
+        response.onFailure5 = onSendFail5;
+        response.context = NULL; // Or the alias_ack_t, the callbacks free it
+
+        if (alias != NULL) {
+            prop.identifier = MQTTPROPERTY_CODE_TOPIC_ALIAS;
+            prop.value.integer2 = alias->alias;
+            MQTTProperties_add(&msg.properties, &prop);
+
+            /* Until a message with the full topic has been acknowledged, the alias means nothing to the broker */
+            if (atomic_load(&alias->known) == alias_connection) {
+                destination = "";
+            } else if ((ack = malloc(sizeof(alias_ack_t))) != NULL) {
+                ack->alias = alias;
+                ack->connection = alias_connection;
+                response.context = ack;
+            }
+        }
+
+        if (expires && msg_expiry > 0) {
+            prop.identifier = MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL;
+            prop.value.integer4 = msg_expiry;
+            MQTTProperties_add(&msg.properties, &prop);
+        }
+
+        if (stamp != NULL) {
+            add_user_property(&msg.properties, "ts_read", stamp->ts_read);
+            add_user_property(&msg.properties, "ts_wall", stamp->ts_wall);
+        }
+
+        rc = MQTTAsync_sendMessage(client, destination, &msg, &response);
+
+        /* No callback comes for a message not even queued */
+        if (rc != MQTTASYNC_SUCCESS) {
+            free(ack);
+        }
+
+        MQTTProperties_free(&msg.properties);
+    } else {
+        response.onSuccess = onSend;
+        response.onFailure = onSendFail;
+
+        rc = MQTTAsync_sendMessage(client, topic, &msg, &response);
+    }
+
+#ifdef MQTT_WAIT_PUBLISHING
+    while (rc == MQTTASYNC_SUCCESS && !published) nanosleep(&read_wait, NULL);
+    published = 0;
+#endif
 }
 
 static void onConnect(void* context, MQTTAsync_successData* response)
@@ -221,6 +578,76 @@ static void onConnectFailure(void* context, MQTTAsync_failureData* response)
     printf("Failed to connect to MQTT server.\n");
 }
 
+static void onConnect5(void* context, MQTTAsync_successData5* response)
+{
+    int max = 0;
+
+    if (MQTTProperties_hasProperty(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)) {
+        max = MQTTProperties_getNumericValue(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+    }
+
+    pthread_mutex_lock(&conn_lock);
+    alias_max = max;
+    pthread_mutex_unlock(&conn_lock);
+
+    printf("Connected to MQTT server over MQTT 5, %d topic aliases allowed\n", max);
+
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+    msg.payload = "online";
+    msg.payloadlen = strlen(msg.payload);
+    msg.qos = 1;
+    msg.retained = 0;
+
+    MQTTAsync_sendMessage(client, lwt_topic, &msg, NULL);
+}
+
+/*
+ * A broker which refused MQTT 5 as such is retried with 3.1.1 on next
+ * publish. Other failures, a broker down or credentials refused, are not a
+ * reason to give up MQTT 5.
+ */
+static void onConnectFailure5(void* context, MQTTAsync_failureData5* response)
+{
+    int unsupported = response != NULL
+        && (response->reasonCode == MQTTREASONCODE_UNSUPPORTED_PROTOCOL_VERSION
+            || response->code == CONNACK_UNACCEPTABLE_VERSION);
+
+    printf("Failed to connect to MQTT server over MQTT 5%s.\n", unsupported ? ", protocol version refused" : "");
+
+    pthread_mutex_lock(&conn_lock);
+
+    if (connections == 0 && unsupported) {
+        fallback = 1;
+    }
+
+    pthread_mutex_unlock(&conn_lock);
+}
+
+/* Called on every connect and automatic reconnect */
+static void onConnected(void* context, char* cause)
+{
+    pthread_mutex_lock(&conn_lock);
+    connections++;
+    pthread_mutex_unlock(&conn_lock);
+
+    /* Clean session, so subscribe anew every time */
+    if (read_handler != NULL) {
+        MQTTAsync_subscribe(client, read_topic, 1, NULL);
+    }
+}
+
+static int onMessage(void* context, char* topicName, int topicLen, MQTTAsync_message* message)
+{
+    if (strcmp(topicName, read_topic) == 0) {
+        read_handler(message->payload, message->payloadlen);
+    }
+
+    MQTTAsync_freeMessage(&message);
+    MQTTAsync_free(topicName);
+
+    return 1;
+}
+
 static void onDisconnect(void* context, MQTTAsync_successData* response)
 {
     MQTTAsync_destroy(&client);
@@ -242,6 +669,48 @@ static void onSendFail(void* context, MQTTAsync_failureData* response)
 #endif
 }
 
+static void onSend5(void* context, MQTTAsync_successData5* response)
+{
+    alias_ack_t *ack = context;
+
+    if (ack != NULL) {
+        atomic_store(&ack->alias->known, ack->connection);
+        free(ack);
+    }
+
+#ifdef MQTT_WAIT_PUBLISHING
+    published = 1;
+#endif
+}
+
+static void onSendFail5(void* context, MQTTAsync_failureData5* response)
+{
+    fprintf(stderr, "Message sending failed, reason %d.\n", response->reasonCode);
+
+    /* The alias stays unknown, the full topic is sent again */
+    free(context);
+
+#ifdef MQTT_WAIT_PUBLISHING
+    published = 1;
+#endif
+}
+
+/* Dump and release `json` into the payload buffer, -1 if it does not fit whole */
+static int payload_json(json_t *json)
+{
+    size_t len = (json != NULL) ? json_dumpb(json, payload, PAYLOAD_SIZE - 1, JSON_COMPACT) : 0;
+
+    json_decref(json);
+
+    if (len == 0 || len >= PAYLOAD_SIZE) {
+        return -1;
+    }
+
+    payload[len] = '\0';
+
+    return 0;
+}
+
 static void beautify_float_str(char *str)
 {
     uint16_t l = strlen(str);
@@ -257,3 +726,38 @@ static void beautify_float_str(char *str)
         }
     }
 }
+
+/* The client is a single static one, so is the sink context */
+static void *sink_open(const char *args)
+{
+    const char *port = strchr(args, ':');
+    const char *topic_base = (port != NULL) ? strchr(port, '/') : NULL;
+
+    if (topic_base == NULL) {
+        fprintf(stderr, "MQTT sink expects <server>:<port>/<topic>, got %s\n", args);
+        return NULL;
+    }
+
+    snprintf(server_arg, TOPIC_SIZE, "%.*s", (int) (port - args), args);
+    snprintf(topic_arg, TOPIC_SIZE, "%s", topic_base + 1);
+
+    mqtt_open(server_arg, strtol(port + 1, NULL, 10), topic_arg);
+
+    return &client;
+}
+
+static int sink_write(void *ctx, const temp_snapshot_t *snap)
+{
+    mqtt_send(snap);
+
+    return 0;
+}
+
+static void sink_close(void *ctx)
+{
+    mqtt_close();
+}
+
+const temp_sink_api_t mqtt_sink = {
+    TEMP_SINK_ABI, "mqtt", sink_open, sink_write, NULL, sink_close
+};
@@ -1,7 +1,20 @@
 #include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+
+void mqtt_config(int mqtt5, long expiry, int binary);
 
 void mqtt_open(char *server, int port, char *topic_base);
 
-void mqtt_send(wire_t *wires, int wire_count);
+void mqtt_send(const temp_snapshot_t *snap);
 
 void mqtt_close();
+
+void mqtt_alert(const char *payload);
+
+void mqtt_on_read(void (*handler)(const char *name, int len));
+
+void mqtt_read_result(const char *payload);
+
+/* Sink arguments: <server>:<port>/<topic> */
+extern const temp_sink_api_t mqtt_sink;
@@ -0,0 +1,39 @@
+#include "temp_types.h"
+#include "temp_aggregate.h"
+
+void aggregate_init(thermometer_t *thermo)
+{
+    thermo->agg_count = 0;
+    thermo->win_count = 0;
+}
+
+void aggregate_add(thermometer_t *thermo, float value)
+{
+    if (thermo->agg_count == 0) {
+        thermo->agg_min = value;
+        thermo->agg_max = value;
+        thermo->agg_sum = 0;
+    } else if (value < thermo->agg_min) {
+        thermo->agg_min = value;
+    } else if (value > thermo->agg_max) {
+        thermo->agg_max = value;
+    }
+
+    thermo->agg_sum += value;
+    thermo->agg_last = value;
+    thermo->agg_count++;
+}
+
+void aggregate_close(thermometer_t *thermo)
+{
+    thermo->win_count = thermo->agg_count;
+
+    if (thermo->agg_count > 0) {
+        thermo->win_min = thermo->agg_min;
+        thermo->win_max = thermo->agg_max;
+        thermo->win_mean = thermo->agg_sum / thermo->agg_count;
+        thermo->win_last = thermo->agg_last;
+    }
+
+    thermo->agg_count = 0;
+}
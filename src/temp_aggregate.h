@@ -0,0 +1,17 @@
+#ifndef __TEMP_AGGREGATE_H__
+#define __TEMP_AGGREGATE_H__
+
+#include "temp_types.h"
+
+/*
+ * Per-sensor aggregates over a publishing window: every accepted reading is
+ * added to the running minimum, maximum and sum, and when the window closes
+ * they are moved to the published ones (win_*) and started anew.
+ */
+void aggregate_init(thermometer_t *thermo);
+
+void aggregate_add(thermometer_t *thermo, float value);
+
+void aggregate_close(thermometer_t *thermo);
+
+#endif /* __TEMP_AGGREGATE_H__ */
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <jansson.h>
+
+#include "temp_types.h"
+#include "temp_time.h"
+#include "temp_alert.h"
+#include "temp_log.h"
+#include "mqtt_output.h"
+
+#define ALERT_LINE_SIZE 256
+#define ALERT_PAYLOAD_SIZE 384
+#define ALERT_JSON_FLAGS (JSON_COMPACT | JSON_REAL_PRECISION(7)) // Floats have no more digits
+
+static alert_rule_t *rules = NULL;
+static int rule_count = 0;
+
+static int fd = -1;
+static struct sockaddr_un addr;
+static int to_mqtt = 0;
+
+static int parse_limit(const char *field, float *limit)
+{
+    char *end;
+
+    if (strcmp(field, "-") == 0) {
+        *limit = NAN;
+        return 0;
+    }
+
+    *limit = strtof(field, &end);
+
+    return (end == field || *end != '\0') ? -1 : 0;
+}
+
+static int rules_load(const char *file_name)
+{
+    char line[ALERT_LINE_SIZE];
+    FILE *f = fopen(file_name, "r");
+
+    if (f == NULL) {
+        perror("Error opening alert rules");
+        return -1;
+    }
+
+    while (fgets(line, ALERT_LINE_SIZE, f) != NULL) {
+        char sensor[ALERT_LINE_SIZE], low[32], high[32], rate[32], hysteresis[32];
+        alert_rule_t rule;
+
+        if (line[0] == '#' || sscanf(line, "%255s", sensor) != 1) {
+            continue;
+        }
+
+        if (sscanf(line, "%255s %31s %31s %31s %31s", sensor, low, high, rate, hysteresis) != 5
+            || parse_limit(low, &rule.low) != 0 || parse_limit(high, &rule.high) != 0
+            || parse_limit(rate, &rule.rate) != 0 || parse_limit(hysteresis, &rule.hysteresis) != 0) {
+            fprintf(stderr, "Bad alert rule: %s", line);
+            fclose(f);
+            return -1;
+        }
+
+        if (isnan(rule.hysteresis)) {
+            rule.hysteresis = 0;
+        }
+
+        alert_rule_t *r = realloc(rules, (rule_count + 1) * sizeof(alert_rule_t));
+
+        if (r == NULL) {
+            fclose(f);
+            return -1;
+        }
+
+        rules = r;
+        rule.sensor = malloc(strlen(sensor) + 1);
+
+        if (rule.sensor == NULL) {
+            fclose(f);
+            return -1;
+        }
+
+        strcpy(rule.sensor, sensor);
+        rules[rule_count++] = rule;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+int alert_open(const char *rules_file, const char *socket_path, int mqtt)
+{
+    if (rules_file != NULL && rules_load(rules_file) != 0) {
+        return -1;
+    }
+
+    to_mqtt = mqtt;
+
+    if (socket_path == NULL) {
+        return 0;
+    }
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Unix socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (fd == -1) {
+        perror("Error creating alert socket");
+        return -1;
+    }
+
+    /* Never hold up the wire thread, an alert nobody listens for is dropped */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    return 0;
+}
+
+void alert_close()
+{
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    for (int i = 0; i < rule_count; i++) {
+        free(rules[i].sensor);
+    }
+
+    free(rules);
+    rules = NULL;
+    rule_count = 0;
+}
+
+void alert_init(thermometer_t *thermo)
+{
+    char rom[17];
+    const uint8_t *a = thermo->address;
+    const alert_rule_t *fallback = NULL;
+
+    snprintf(rom, sizeof(rom), "%02X%02X%02X%02X%02X%02X%02X%02X", a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+    thermo->alert_rule = NULL;
+    thermo->alert_state = 0;
+    thermo->alert_ref_ts = 0;
+
+    for (int i = 0; i < rule_count; i++) {
+        if (strcmp(rules[i].sensor, rom) == 0) {
+            thermo->alert_rule = &rules[i];
+            return;
+        }
+
+        if (thermo->alias != NULL && strcmp(rules[i].sensor, thermo->alias) == 0) {
+            fallback = &rules[i];
+        } else if (fallback == NULL && strcmp(rules[i].sensor, "*") == 0) {
+            fallback = &rules[i];
+        }
+    }
+
+    thermo->alert_rule = fallback;
+}
+
+static void alert_send(thermometer_t *thermo, const char *kind, int raised, float rate, float limit)
+{
+    char payload[ALERT_PAYLOAD_SIZE];
+    char rom[17];
+    const uint8_t *a = thermo->address;
+
+    snprintf(rom, sizeof(rom), "%02X%02X%02X%02X%02X%02X%02X%02X", a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+    /* Built by jansson, so the alias is escaped */
+    json_t *jalert = json_object();
+
+    json_object_set_new(jalert, "address", json_string(rom));
+    json_object_set_new(jalert, "id", json_integer(thermo->id));
+    json_object_set_new(jalert, "alias", json_string((thermo->alias != NULL) ? thermo->alias : ""));
+    json_object_set_new(jalert, "alert", json_string(kind));
+    json_object_set_new(jalert, "state", json_string(raised ? "raised" : "cleared"));
+    json_object_set_new(jalert, "temperature", json_real(thermo->temperature));
+    json_object_set_new(jalert, "rate", json_real(rate));
+    json_object_set_new(jalert, "limit", json_real(limit));
+    json_object_set_new(jalert, "ts_wall", json_integer(thermo->ts_wall));
+
+    size_t len = json_dumpb(jalert, payload, sizeof(payload) - 1, ALERT_JSON_FLAGS);
+
+    json_decref(jalert);
+
+    /* Never send out more than the buffer holds, nor a cut message */
+    if (len == 0 || len >= sizeof(payload)) {
+        log_limited(LOG_ERROR, "Alert %s @ %s does not fit into %d bytes, not sent\n", kind, rom, ALERT_PAYLOAD_SIZE);
+        return;
+    }
+
+    payload[len] = '\0';
+
+    log_info("[%ld] Alert %s %s @ %02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X: %.2f C, %.2f C/min\n",
+        (long) (time_mono_ns() / NS_PER_S), kind, raised ? "raised" : "cleared",
+        a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], thermo->temperature, rate);
+
+    if (fd != -1 && sendto(fd, payload, len, 0, (struct sockaddr *) &addr, sizeof(addr)) == -1
+        && errno != EAGAIN && errno != ENOENT && errno != ECONNREFUSED) {
+        perror("Error sending alert");
+    }
+
+    if (to_mqtt) {
+        mqtt_alert(payload);
+    }
+}
+
+/* Raise or clear one alert, with hysteresis: `over` raises it, only `back` clears it */
+static void alert_update(thermometer_t *thermo, int alert, const char *kind, int over, int back, float rate, float limit)
+{
+    int raised = thermo->alert_state & alert;
+
+    if (!raised && over) {
+        thermo->alert_state |= alert;
+        alert_send(thermo, kind, 1, rate, limit);
+    } else if (raised && back) {
+        thermo->alert_state &= ~alert;
+        alert_send(thermo, kind, 0, rate, limit);
+    }
+}
+
+/*
+ * Called by the wire thread after an accepted reading. Rate of change is
+ * measured against a reference reading at least ALERT_RATE_MIN_NS old, so
+ * quantization of fast readings does not look like a fast change.
+ */
+void alert_check(thermometer_t *thermo)
+{
+    const alert_rule_t *rule = thermo->alert_rule;
+    float t = thermo->temperature;
+    float rate = 0;
+
+    if (rule == NULL) {
+        return;
+    }
+
+    if (thermo->alert_ref_ts == 0) {
+        thermo->alert_ref = t;
+        thermo->alert_ref_ts = thermo->ts_read;
+    } else if (thermo->ts_read - thermo->alert_ref_ts >= ALERT_RATE_MIN_NS) {
+        uint64_t span = thermo->ts_read - thermo->alert_ref_ts;
+
+        rate = (t - thermo->alert_ref) * 60.0 * NS_PER_S / span;
+
+        if (!isnan(rule->rate)) {
+            alert_update(thermo, ALERT_RATE, "rate", fabsf(rate) > rule->rate, fabsf(rate) < rule->rate / 2,
+                rate, rule->rate);
+        }
+
+        if (span >= ALERT_RATE_SPAN_NS) {
+            thermo->alert_ref = t;
+            thermo->alert_ref_ts = thermo->ts_read;
+        }
+    }
+
+    if (!isnan(rule->high)) {
+        alert_update(thermo, ALERT_HIGH, "high", t > rule->high, t < rule->high - rule->hysteresis, rate, rule->high);
+    }
+
+    if (!isnan(rule->low)) {
+        alert_update(thermo, ALERT_LOW, "low", t < rule->low, t > rule->low + rule->hysteresis, rate, rule->low);
+    }
+}
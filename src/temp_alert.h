@@ -0,0 +1,44 @@
+#ifndef __TEMP_ALERT_H__
+#define __TEMP_ALERT_H__
+
+#include "temp_types.h"
+
+#define ALERT_LOW 0x01
+#define ALERT_HIGH 0x02
+#define ALERT_RATE 0x04
+
+#define ALERT_RATE_MIN_NS (5 * 1000000000ULL) // Shortest span to measure rate of change over
+#define ALERT_RATE_SPAN_NS (30 * 1000000000ULL) // Longest, then the reference reading moves on
+
+/*
+ * Threshold and rate of change alerts, checked by the wire thread right
+ * after every accepted reading, so an alert does not wait for the rest of
+ * the cycle nor for the sinks. Rules are read from a file, one per line:
+ *
+ *   <ROM|alias|*> <low> <high> <rate> <hysteresis>
+ *
+ * Temperatures in C, rate in C per minute either way, `-` for no limit. A
+ * sensor takes the rule of its ROM (hex, as in the registry), else of its
+ * alias, else the `*` one. An alert is raised once the limit is crossed and
+ * cleared once the temperature is back by `hysteresis`, the rate under half
+ * of the limit, so a value around the limit does not flap.
+ */
+typedef struct alert_rule {
+    char *sensor;
+    float low; // NAN for none
+    float high;
+    float rate;
+    float hysteresis;
+} alert_rule_t;
+
+/* Rules file, Unix datagram socket to send alerts to and whether to send them to MQTT too */
+int alert_open(const char *rules_file, const char *socket_path, int mqtt);
+
+void alert_close();
+
+/* Picks the rule of a new sensor */
+void alert_init(thermometer_t *thermo);
+
+void alert_check(thermometer_t *thermo);
+
+#endif /* __TEMP_ALERT_H__ */
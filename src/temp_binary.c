@@ -0,0 +1,111 @@
+#include <string.h>
+#include <math.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_binary.h"
+
+static void put_u16(uint8_t *b, uint16_t v)
+{
+    b[0] = v & 0xFF;
+    b[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *b, uint32_t v)
+{
+    put_u16(b, v & 0xFFFF);
+    put_u16(b + 2, v >> 16);
+}
+
+static void put_u64(uint8_t *b, uint64_t v)
+{
+    put_u32(b, v & 0xFFFFFFFF);
+    put_u32(b + 4, v >> 32);
+}
+
+static uint16_t get_u16(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *b)
+{
+    return get_u16(b) | ((uint32_t) get_u16(b + 2) << 16);
+}
+
+static uint64_t get_u64(const uint8_t *b)
+{
+    return get_u32(b) | ((uint64_t) get_u32(b + 4) << 32);
+}
+
+size_t binary_size(int count)
+{
+    return BINARY_HEADER_SIZE + (size_t) count * BINARY_RECORD_SIZE;
+}
+
+/*
+ * Encode the snapshot into `buf`. Returns the length, 0 if `size` is not
+ * enough. No text formatting involved, temperature is scaled to the raw
+ * 1/16 C units, which is exact for unfiltered DS18B20 family readings.
+ */
+size_t binary_encode(const temp_snapshot_t *snap, uint8_t *buf, size_t size)
+{
+    size_t len = binary_size(snap->thermo_count);
+
+    if (len > size || snap->thermo_count > UINT16_MAX) {
+        return 0;
+    }
+
+    memcpy(buf, BINARY_MAGIC, 3);
+    buf[3] = BINARY_VERSION;
+    buf[4] = BINARY_RECORD_SIZE;
+    buf[5] = 0;
+    put_u16(buf + 6, snap->thermo_count);
+    put_u64(buf + 8, snap->ts_wall);
+
+    uint8_t *rec = buf + BINARY_HEADER_SIZE;
+
+    for (int t = 0; t < snap->thermo_count; t++, rec += BINARY_RECORD_SIZE) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        int32_t offset = BINARY_NEVER_READ;
+
+        if (thermo->ts_wall > 0) {
+            int64_t ms = ((int64_t) thermo->ts_wall - (int64_t) snap->ts_wall) / 1000000;
+            offset = (ms < -INT32_MAX) ? -INT32_MAX : (ms > INT32_MAX) ? INT32_MAX : ms;
+        }
+
+        memcpy(rec, thermo->address, 8);
+        put_u16(rec + 8, (uint16_t) (int16_t) lroundf(thermo->temperature * 16));
+        rec[10] = thermo->status;
+        rec[11] = 0;
+        put_u32(rec + 12, (uint32_t) offset);
+    }
+
+    return len;
+}
+
+/* Returns 0 if the header is valid, count and record size are set then */
+int binary_decode_header(const uint8_t *buf, size_t size, int *count, int *record_size, uint64_t *ts_wall)
+{
+    if (size < BINARY_HEADER_SIZE || memcmp(buf, BINARY_MAGIC, 3) != 0) {
+        return -1;
+    }
+
+    if (buf[3] != BINARY_VERSION || buf[4] < BINARY_RECORD_SIZE) {
+        return -2;
+    }
+
+    *record_size = buf[4];
+    *count = get_u16(buf + 6);
+    *ts_wall = get_u64(buf + 8);
+
+    return 0;
+}
+
+void binary_decode_record(const uint8_t *rec, binary_reading_t *reading)
+{
+    memcpy(reading->address, rec, 8);
+    reading->raw = (int16_t) get_u16(rec + 8);
+    reading->status = rec[10];
+    reading->ts_offset_ms = (int32_t) get_u32(rec + 12);
+}
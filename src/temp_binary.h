@@ -0,0 +1,53 @@
+#ifndef __TEMP_BINARY_H__
+#define __TEMP_BINARY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "temp_snapshot.h"
+
+/*
+ * Compact binary encoding of a snapshot, used for binary file output and
+ * MQTT batches. All fields are little endian.
+ *
+ * Header, 16 bytes:
+ *   0  magic "TDB"
+ *   3  version
+ *   4  record size
+ *   5  reserved, 0
+ *   6  count of records, uint16
+ *   8  wall clock of the read cycle, ns since the Epoch, uint64
+ *
+ * Followed by `count` records, one per sensor, 16 bytes each:
+ *   0  ROM, 8 bytes, family code first
+ *   8  temperature, int16, 1/16 C (DS18B20 scratchpad format)
+ *  10  status, 1 for OK, 0 for failure
+ *  11  reserved, 0
+ *  12  time of the read relative to the header's, ms, int32,
+ *      BINARY_NEVER_READ if the sensor has not been read yet
+ *
+ * Decoders should skip unknown trailing bytes of a record, as newer
+ * versions may append fields and raise the record size.
+ */
+#define BINARY_MAGIC "TDB"
+#define BINARY_VERSION 1
+#define BINARY_HEADER_SIZE 16
+#define BINARY_RECORD_SIZE 16
+#define BINARY_NEVER_READ INT32_MIN
+
+typedef struct binary_reading {
+    uint8_t address[8];
+    int16_t raw;
+    uint8_t status;
+    int32_t ts_offset_ms;
+} binary_reading_t;
+
+size_t binary_size(int count);
+
+size_t binary_encode(const temp_snapshot_t *snap, uint8_t *buf, size_t size);
+
+int binary_decode_header(const uint8_t *buf, size_t size, int *count, int *record_size, uint64_t *ts_wall);
+
+void binary_decode_record(const uint8_t *rec, binary_reading_t *reading);
+
+#endif /* __TEMP_BINARY_H__ */
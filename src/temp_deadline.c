@@ -0,0 +1,111 @@
+#define _GNU_SOURCE // pthread_kill, pthread_condattr_setclock
+
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "temp_time.h"
+#include "temp_deadline.h"
+
+static _Thread_local uint64_t deadline = 0;
+static _Thread_local int cancelled = 0;
+static _Thread_local volatile sig_atomic_t stalled = 0;
+
+/* Runs on the kicked thread, interrupting its blocking call */
+static void on_kick(int sig)
+{
+    stalled = 1;
+}
+
+int deadline_init()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_kick;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // No SA_RESTART
+
+    return sigaction(DEADLINE_SIGNAL, &sa, NULL);
+}
+
+void deadline_set(uint64_t deadline_ns)
+{
+    deadline = deadline_ns;
+    cancelled = 0;
+    stalled = 0;
+}
+
+int deadline_passed()
+{
+    if (deadline == 0) {
+        return 0;
+    }
+
+    if (!cancelled && time_mono_ns() >= deadline) {
+        cancelled = 1;
+    }
+
+    return cancelled;
+}
+
+uint64_t deadline_left()
+{
+    if (deadline == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t now = time_mono_ns();
+
+    return (now < deadline) ? deadline - now : 0;
+}
+
+void deadline_cancel()
+{
+    cancelled = 1;
+}
+
+int deadline_cancelled()
+{
+    return cancelled;
+}
+
+void deadline_stall()
+{
+    stalled = 1;
+}
+
+int deadline_stalled()
+{
+    return stalled;
+}
+
+void deadline_kick(pthread_t tid)
+{
+    pthread_kill(tid, DEADLINE_SIGNAL);
+}
+
+int deadline_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    if (pthread_condattr_init(&attr) != 0) {
+        return -1;
+    }
+
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    int rc = pthread_cond_init(cond, &attr);
+
+    pthread_condattr_destroy(&attr);
+
+    return rc == 0 ? 0 : -1;
+}
+
+int deadline_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t deadline_ns)
+{
+    struct timespec ts = { .tv_sec = deadline_ns / NS_PER_S, .tv_nsec = deadline_ns % NS_PER_S };
+
+    return pthread_cond_timedwait(cond, mutex, &ts);
+}
@@ -0,0 +1,51 @@
+#ifndef __TEMP_DEADLINE_H__
+#define __TEMP_DEADLINE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define DEADLINE_GRACE_NS (20 * 1000000ULL) // Wait this long past the deadline before kicking a stalled thread
+
+/*
+ * Deadlines of wire threads. Each wire thread gets the deadline of its read
+ * cycle; once it has passed, every driver call of the thread fails right
+ * away (checked in the wrapped driver calls, see temp_record.c), so the
+ * transaction in progress is abandoned at the next bit or byte. A thread
+ * blocked inside the driver is kicked with DEADLINE_SIGNAL, which has a
+ * handler without SA_RESTART, so a blocking read returns with EINTR, and
+ * the thread is marked stalled. A kick arriving between the deadline check
+ * and the start of the blocking call is lost, so a thread still busy is
+ * kicked again every DEADLINE_GRACE_NS until it is out.
+ */
+#define DEADLINE_SIGNAL SIGUSR1
+
+int deadline_init();
+
+/* Deadline of the calling thread, monotonic ns, 0 for none. Clears cancellation. */
+void deadline_set(uint64_t deadline_ns);
+
+/* Whether the deadline of the calling thread has passed, marks it cancelled if so */
+int deadline_passed();
+
+/* Time left until the deadline of the calling thread, UINT64_MAX if it has none */
+uint64_t deadline_left();
+
+void deadline_cancel();
+
+/* Whether a driver call of the calling thread was refused since the deadline was set */
+int deadline_cancelled();
+
+/* Whether the calling thread was kicked since the deadline was set */
+int deadline_stalled();
+
+void deadline_stall();
+
+void deadline_kick(pthread_t tid);
+
+/* Condition variable waited for with deadline_wait(), on the monotonic clock */
+int deadline_cond_init(pthread_cond_t *cond);
+
+/* Returns 0 when signalled, ETIMEDOUT when the deadline passed */
+int deadline_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t deadline_ns);
+
+#endif /* __TEMP_DEADLINE_H__ */
@@ -0,0 +1,111 @@
+#include <stddef.h>
+
+#include "onewire.h"
+#include "dallas.h"
+#include "temp_time.h"
+#include "temp_family.h"
+
+#define FAMILY_CMD_MATCH_ROM 0x55
+#define FAMILY_CMD_WRITE_SCRATCHPAD 0x4E
+
+static float convert_ds18b20(const uint8_t *scratchpad);
+static float convert_ds18s20(const uint8_t *scratchpad);
+
+/*
+ * DS18B20 and alike report 1/16 C in the first two bytes. DS18S20 reports
+ * 1/2 C only, full resolution is calculated from COUNT_REMAIN and
+ * COUNT_PER_C, which are the 7th and 8th bytes of the scratchpad.
+ */
+static const temp_family_t families[256] = {
+    [FAMILY_DS18S20] = { "DS18S20", SCR_10H + 1, 0, convert_ds18s20 },
+    [FAMILY_DS1822]  = { "DS1822",  SCR_H + 1,   1, convert_ds18b20 },
+    [FAMILY_DS18B20] = { "DS18B20", SCR_H + 1,   1, convert_ds18b20 },
+    [FAMILY_DS1825]  = { "DS1825",  SCR_H + 1,   1, convert_ds18b20 },
+};
+
+/* Maximal conversion time of 9 to 12 bit resolution, ms, as per datasheet */
+static const uint16_t conversion_ms[] = { 94, 188, 375, 750 };
+
+/*
+ * Returns NULL for devices which are not known thermometers.
+ */
+const temp_family_t *family_get(uint8_t code)
+{
+    if (families[code].convert == NULL) {
+        return NULL;
+    }
+
+    return &families[code];
+}
+
+/*
+ * Time to wait for conversion at given resolution, with 10% margin. If
+ * resolution is not set (0), sensors keep their own, thus a full second is
+ * waited as always.
+ */
+uint64_t family_conversion_ns(const temp_family_t *family, int bits)
+{
+    if (bits == 0) {
+        return NS_PER_S;
+    }
+
+    if (!family->has_resolution) {
+        bits = 12;
+    }
+
+    return conversion_ms[bits - 9] * NS_PER_MS * 11 / 10;
+}
+
+/*
+ * Write resolution into configuration register, if it differs, keeping the
+ * alarm bytes from the full `scratchpad`. Not copied into EEPROM, so it has
+ * to be written again after sensor's power loss, i.e. on every search.
+ */
+int family_set_resolution(ow_driver_ptr driver, const uint8_t *address, const uint8_t *scratchpad, int bits)
+{
+    uint8_t cfg = ((bits - 9) << 5) | 0x1F;
+
+    if (scratchpad[SCR_CFG] == cfg) {
+        return OW_OK;
+    }
+
+    if (ow_reset(driver) != OW_OK) {
+        return OW_ERR;
+    }
+
+    uint8_t command[] = {
+        FAMILY_CMD_MATCH_ROM,
+        address[0], address[1], address[2], address[3],
+        address[4], address[5], address[6], address[7],
+        FAMILY_CMD_WRITE_SCRATCHPAD,
+        scratchpad[SCR_HI_ALARM], scratchpad[SCR_LO_ALARM], cfg
+    };
+
+    for (unsigned int i = 0; i < sizeof(command); i++) {
+        if (ow_write_byte(driver, command[i]) != OW_OK) {
+            return OW_ERR;
+        }
+    }
+
+    return ow_reset(driver);
+}
+
+static float convert_ds18b20(const uint8_t *scratchpad)
+{
+    int16_t raw = (int16_t) (scratchpad[SCR_H] << 8 | scratchpad[SCR_L]);
+
+    return raw / 16.0f;
+}
+
+static float convert_ds18s20(const uint8_t *scratchpad)
+{
+    int16_t raw = (int16_t) (scratchpad[SCR_H] << 8 | scratchpad[SCR_L]);
+    uint8_t count_remain = scratchpad[SCR_RESERVED];
+    uint8_t count_per_c = scratchpad[SCR_10H];
+
+    if (count_per_c == 0) {
+        return raw / 2.0f;
+    }
+
+    return (raw >> 1) - 0.25f + (float) (count_per_c - count_remain) / count_per_c;
+}
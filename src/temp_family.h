@@ -0,0 +1,31 @@
+#ifndef __TEMP_FAMILY_H__
+#define __TEMP_FAMILY_H__
+
+#include <stdint.h>
+
+#include "onewire.h"
+
+#define FAMILY_DS18S20 0x10
+#define FAMILY_DS1822 0x22
+#define FAMILY_DS18B20 0x28
+#define FAMILY_DS1825 0x3B
+
+/*
+ * Dallas thermometer family, dispatched by the first byte of the ROM: how
+ * many scratchpad bytes are needed for the temperature and how to convert
+ * them, also whether its resolution can be set.
+ */
+typedef struct temp_family {
+    const char *name;
+    uint8_t read_length;
+    uint8_t has_resolution; // Resolution is configurable, 9 to 12 bits
+    float (*convert)(const uint8_t *scratchpad);
+} temp_family_t;
+
+const temp_family_t *family_get(uint8_t code);
+
+uint64_t family_conversion_ns(const temp_family_t *family, int bits);
+
+int family_set_resolution(ow_driver_ptr driver, const uint8_t *address, const uint8_t *scratchpad, int bits);
+
+#endif /* __TEMP_FAMILY_H__ */
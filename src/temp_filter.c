@@ -0,0 +1,140 @@
+#include <math.h>
+#include <string.h>
+
+#include "temp_types.h"
+#include "temp_filter.h"
+
+static int enabled = 0;
+static int window = 1;
+static float spike = 0;
+static float alpha = 0;
+
+static float filter_median(thermometer_t *thermo);
+static void filter_push(thermometer_t *thermo, float value);
+
+void filter_config(int median_window, float spike_limit, float ema_alpha)
+{
+    window = (median_window > FILTER_MAX) ? FILTER_MAX : median_window;
+    window = (window < 1) ? 1 : window;
+    spike = (spike_limit > 0) ? spike_limit : 0;
+    alpha = (ema_alpha > 0 && ema_alpha < 1) ? ema_alpha : 0;
+
+    enabled = (window > 1 || spike > 0 || alpha > 0);
+}
+
+void filter_init(thermometer_t *thermo)
+{
+    thermo->filter_count = 0;
+    thermo->filter_head = 0;
+    thermo->filter_rejects = 0;
+    thermo->filter_ema = 0;
+    thermo->spikes = 0;
+}
+
+/*
+ * Feed a new reading through the filter and set the reported temperature.
+ * A rejected reading leaves the temperature as it was. A change which
+ * persists over more than half of the window is real, not a spike: it is
+ * accepted and the history restarts from it.
+ */
+int filter_apply(thermometer_t *thermo, float value)
+{
+    if (!enabled) {
+        thermo->temperature = value;
+        return FILTER_ACCEPTED;
+    }
+
+    int reject = (value == FILTER_ERROR_C);
+
+    if (thermo->filter_count > 0) {
+        float median = filter_median(thermo);
+
+        /* Power-on value is suspicious unless the sensor really is about that hot */
+        if (value == FILTER_POWER_ON_C && fabsf(median - FILTER_POWER_ON_C) > 1.0f) {
+            reject = 1;
+        }
+
+        if (spike > 0 && fabsf(value - median) > spike) {
+            reject = 1;
+        }
+    } else if (value == FILTER_POWER_ON_C) {
+        reject = 1;
+    }
+
+    if (reject) {
+        thermo->spikes++;
+        thermo->filter_rejects++;
+
+        if (thermo->filter_rejects <= window / 2 + 1 || value == FILTER_ERROR_C) {
+            return FILTER_REJECTED;
+        }
+
+        thermo->filter_count = 0;
+        thermo->filter_head = 0;
+    }
+
+    thermo->filter_rejects = 0;
+
+    int first = (thermo->filter_count == 0);
+
+    filter_push(thermo, value);
+
+    float median = filter_median(thermo);
+
+    if (alpha > 0 && !first) {
+        thermo->filter_ema += alpha * (median - thermo->filter_ema);
+    } else {
+        thermo->filter_ema = median;
+    }
+
+    thermo->temperature = thermo->filter_ema;
+
+    return FILTER_ACCEPTED;
+}
+
+static float filter_median(thermometer_t *thermo)
+{
+    int n = thermo->filter_count;
+
+    if (n % 2) {
+        return thermo->filter_sorted[n / 2];
+    }
+
+    return (thermo->filter_sorted[n / 2 - 1] + thermo->filter_sorted[n / 2]) / 2;
+}
+
+/*
+ * Put the value into the ring and into the sorted copy, dropping the oldest
+ * one from both if the window is full. Takes at most `window` moves.
+ */
+static void filter_push(thermometer_t *thermo, float value)
+{
+    float *sorted = thermo->filter_sorted;
+    int n = thermo->filter_count;
+
+    if (n >= window) {
+        float oldest = thermo->filter_ring[thermo->filter_head];
+        int i = 0;
+
+        while (i < n - 1 && sorted[i] != oldest) {
+            i++;
+        }
+
+        memmove(&sorted[i], &sorted[i + 1], (n - 1 - i) * sizeof(float));
+        n--;
+    } else {
+        thermo->filter_count++;
+    }
+
+    int i = n;
+
+    while (i > 0 && sorted[i - 1] > value) {
+        sorted[i] = sorted[i - 1];
+        i--;
+    }
+
+    sorted[i] = value;
+
+    thermo->filter_ring[thermo->filter_head] = value;
+    thermo->filter_head = (thermo->filter_head + 1) % window;
+}
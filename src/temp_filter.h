@@ -0,0 +1,26 @@
+#ifndef __TEMP_FILTER_H__
+#define __TEMP_FILTER_H__
+
+#include "temp_types.h"
+
+#define FILTER_ACCEPTED 0
+#define FILTER_REJECTED 1
+
+/* Values reported by sensors on power-on and on read error */
+#define FILTER_POWER_ON_C 85.0f
+#define FILTER_ERROR_C -127.0f
+
+/*
+ * Per-sensor filter across read cycles, so it costs no extra bus time:
+ * rejection of error values and spikes, median of the last readings and
+ * exponential moving average, each stage optional. The median is kept
+ * incrementally in a sorted copy of the ring of readings, no re-sorting
+ * nor allocation is done.
+ */
+void filter_config(int median_window, float spike_limit, float ema_alpha);
+
+void filter_init(thermometer_t *thermo);
+
+int filter_apply(thermometer_t *thermo, float value);
+
+#endif /* __TEMP_FILTER_H__ */
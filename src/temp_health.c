@@ -0,0 +1,72 @@
+#include "temp_types.h"
+#include "temp_health.h"
+
+static long quarantine_base = 60;
+
+void health_config(long base_period)
+{
+    quarantine_base = (base_period > 0) ? base_period : 1;
+}
+
+void health_init(thermometer_t *thermo)
+{
+    thermo->crc_errors = 0;
+    thermo->read_errors = 0;
+    thermo->fail_streak = 0;
+    thermo->last_good = 0;
+    thermo->quarantine_until = 0;
+}
+
+int health_available(thermometer_t *thermo, long now)
+{
+    return now >= thermo->quarantine_until;
+}
+
+void health_crc_error(thermometer_t *thermo)
+{
+    thermo->crc_errors++;
+}
+
+/*
+ * Account a failed reading. Returns 1 if sensor has been put into
+ * quarantine by this failure: the first one after HEALTH_QUARANTINE_AFTER
+ * failures lasts one base period, every next one doubles it.
+ */
+int health_fail(thermometer_t *thermo, long now)
+{
+    thermo->read_errors++;
+    thermo->fail_streak++;
+
+    if (thermo->fail_streak < HEALTH_QUARANTINE_AFTER) {
+        return 0;
+    }
+
+    long quarantine = quarantine_base;
+
+    for (int i = HEALTH_QUARANTINE_AFTER; i < thermo->fail_streak && quarantine < HEALTH_QUARANTINE_MAX; i++) {
+        quarantine *= 2;
+    }
+
+    if (quarantine > HEALTH_QUARANTINE_MAX) {
+        quarantine = HEALTH_QUARANTINE_MAX;
+    }
+
+    thermo->quarantine_until = now + quarantine;
+
+    return 1;
+}
+
+/*
+ * Account a good reading. Returns the count of failures in a row before it,
+ * so the caller can report a recovery.
+ */
+int health_ok(thermometer_t *thermo, long now)
+{
+    int streak = thermo->fail_streak;
+
+    thermo->fail_streak = 0;
+    thermo->last_good = now;
+    thermo->quarantine_until = 0;
+
+    return streak;
+}
@@ -0,0 +1,28 @@
+#ifndef __TEMP_HEALTH_H__
+#define __TEMP_HEALTH_H__
+
+#include "temp_types.h"
+
+/* Consecutive failures before sensor is put into quarantine */
+#define HEALTH_QUARANTINE_AFTER 3
+/* Longest quarantine, s */
+#define HEALTH_QUARANTINE_MAX 3600
+
+/*
+ * Per-sensor health. Failing sensors are counted and, after several
+ * consecutive failures, skipped for an exponentially growing time, so a
+ * dead probe does not eat the bus time of the whole line.
+ */
+void health_config(long base_period);
+
+void health_init(thermometer_t *thermo);
+
+int health_available(thermometer_t *thermo, long now);
+
+void health_crc_error(thermometer_t *thermo);
+
+int health_fail(thermometer_t *thermo, long now);
+
+int health_ok(thermometer_t *thermo, long now);
+
+#endif /* __TEMP_HEALTH_H__ */
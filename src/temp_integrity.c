@@ -0,0 +1,56 @@
+#include <math.h>
+
+#include "temp_types.h"
+#include "temp_filter.h"
+#include "temp_integrity.h"
+
+static float jump = 5.0f;
+
+void integrity_config(float jump_limit)
+{
+    jump = jump_limit;
+}
+
+void integrity_init(thermometer_t *thermo)
+{
+    thermo->integrity_rate = 0;
+    thermo->integrity_last = NAN;
+    thermo->escalations = 0;
+}
+
+int integrity_escalated(thermometer_t *thermo)
+{
+    return (thermo->integrity_rate > INTEGRITY_RATE_LIMIT) ? INTEGRITY_ERRORS : 0;
+}
+
+int integrity_suspect(thermometer_t *thermo, float value)
+{
+    int reasons = 0;
+
+    if (value == FILTER_POWER_ON_C) {
+        reasons |= INTEGRITY_POWER_ON;
+    }
+
+    if (value < INTEGRITY_MIN_C || value > INTEGRITY_MAX_C) {
+        reasons |= INTEGRITY_RANGE;
+    }
+
+    /* Nothing to compare the first value with, it is checked in full anyway */
+    if (isnan(thermo->integrity_last) || (jump > 0 && fabsf(value - thermo->integrity_last) > jump)) {
+        reasons |= INTEGRITY_JUMP;
+    }
+
+    return reasons;
+}
+
+void integrity_good(thermometer_t *thermo, float value, int crc_errors)
+{
+    thermo->integrity_last = value;
+    thermo->integrity_rate = thermo->integrity_rate * (1 - INTEGRITY_RATE_WEIGHT)
+        + ((crc_errors > 0) ? INTEGRITY_RATE_WEIGHT : 0);
+}
+
+void integrity_error(thermometer_t *thermo)
+{
+    thermo->integrity_rate = thermo->integrity_rate * (1 - INTEGRITY_RATE_WEIGHT) + INTEGRITY_RATE_WEIGHT;
+}
@@ -0,0 +1,43 @@
+#ifndef __TEMP_INTEGRITY_H__
+#define __TEMP_INTEGRITY_H__
+
+#include "temp_types.h"
+
+#define INTEGRITY_POWER_ON 0x01 // 85 C, the value before the first conversion
+#define INTEGRITY_RANGE 0x02 // Outside what the sensors measure, e.g. a flipped high bit
+#define INTEGRITY_JUMP 0x04 // Too far from the last good value
+#define INTEGRITY_ERRORS 0x08 // Recent errors of the sensor
+
+#define INTEGRITY_MIN_C -55.0f
+#define INTEGRITY_MAX_C 125.0f
+#define INTEGRITY_RATE_WEIGHT (1.0f / 16) // Of the last read in the error rate
+#define INTEGRITY_RATE_LIMIT 0.02f // Error rate to check every read in full above, about 18 good reads after an error
+
+/*
+ * Adaptive integrity checking. Sensors are read the fast way, 2 bytes of
+ * the temperature with no CRC, and only when that value is suspect, or the
+ * sensor has had errors lately, the whole scratchpad is read and its CRC
+ * checked. A suspect value is the power-on 85 C, one out of the range of
+ * the sensors or one differing from the last good value by more than the
+ * jump limit.
+ */
+void integrity_config(float jump_limit);
+
+void integrity_init(thermometer_t *thermo);
+
+/* Reasons to check the next read of the sensor in full right away: INTEGRITY_ERRORS, 0 if none */
+int integrity_escalated(thermometer_t *thermo);
+
+/* Reasons to doubt a value of a 2 byte read, 0 if none */
+int integrity_suspect(thermometer_t *thermo, float value);
+
+/*
+ * Outcome of a read, exactly one of these per read however many attempts it
+ * took: a good value, an error if CRC errors had to be retried, or a failed
+ * read.
+ */
+void integrity_good(thermometer_t *thermo, float value, int crc_errors);
+
+void integrity_error(thermometer_t *thermo);
+
+#endif /* __TEMP_INTEGRITY_H__ */
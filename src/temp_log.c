@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "temp_time.h"
+#include "temp_deadline.h"
+#include "temp_log.h"
+
+typedef struct log_line {
+    uint64_t ts;
+    int level;
+    char text[LOG_LINE_SIZE];
+} log_line_t;
+
+/* Written by its thread only, read by the drain thread only */
+typedef struct log_ring {
+    atomic_uint head; // Next line to write, owned by the producer
+    atomic_uint tail; // Next line to read, owned by the drain thread
+    atomic_ulong dropped;
+    log_line_t lines[LOG_RING_SIZE];
+} log_ring_t;
+
+static log_ring_t *_Atomic rings[LOG_THREADS_MAX];
+static atomic_int ring_count = 0;
+static _Thread_local log_ring_t *ring = NULL;
+static _Thread_local int ring_failed = 0;
+
+static atomic_int level = LOG_INFO;
+
+/* Rate limits used so far, see log_limit_t */
+static log_limit_t *_Atomic limits = NULL;
+
+static atomic_int running = 0;
+static pthread_t drain_tid;
+
+/* The drain thread sleeps until a ring gets its first line or a count of suppressed lines is due */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_cond;
+static int drain_wanted = 0;
+
+static int limit_sweep(int all, uint64_t *next_ns);
+
+static void drain_wake()
+{
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        return;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    drain_wanted = 1;
+    pthread_cond_signal(&drain_cond);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+/* Direct output, before the drain thread runs and for threads without a ring */
+static pthread_mutex_t direct_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void write_line(int line_level, const char *text)
+{
+    FILE *out = (line_level <= LOG_WARN) ? stderr : stdout;
+
+    fputs(text, out);
+}
+
+static void write_direct(int line_level, const char *text)
+{
+    pthread_mutex_lock(&direct_lock);
+    write_line(line_level, text);
+    fflush((line_level <= LOG_WARN) ? stderr : stdout);
+    pthread_mutex_unlock(&direct_lock);
+}
+
+/* Registers a ring for the calling thread on its first line */
+static log_ring_t *ring_get()
+{
+    if (ring != NULL || ring_failed) {
+        return ring;
+    }
+
+    int idx = atomic_fetch_add(&ring_count, 1);
+
+    if (idx >= LOG_THREADS_MAX || (ring = calloc(1, sizeof(log_ring_t))) == NULL) {
+        ring_failed = 1;
+        return NULL;
+    }
+
+    atomic_store_explicit(&rings[idx], ring, memory_order_release);
+
+    return ring;
+}
+
+int log_level()
+{
+    return atomic_load_explicit(&level, memory_order_relaxed);
+}
+
+void log_write(int line_level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (line_level > log_level()) {
+        return;
+    }
+
+    log_ring_t *r = atomic_load_explicit(&running, memory_order_acquire) ? ring_get() : NULL;
+
+    if (r == NULL) {
+        char text[LOG_LINE_SIZE];
+
+        va_start(args, fmt);
+        vsnprintf(text, sizeof(text), fmt, args);
+        va_end(args);
+
+        write_direct(line_level, text);
+        return;
+    }
+
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if (head - tail >= LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    log_line_t *line = &r->lines[head % LOG_RING_SIZE];
+
+    line->ts = time_mono_ns();
+    line->level = line_level;
+
+    va_start(args, fmt);
+    int len = vsnprintf(line->text, LOG_LINE_SIZE, fmt, args);
+    va_end(args);
+
+    /* Keep the line a line when cut short */
+    if (len >= LOG_LINE_SIZE) {
+        line->text[LOG_LINE_SIZE - 2] = '\n';
+    }
+
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    /* The drain thread goes on while it finds lines, it has to be woken only for the first one */
+    if (head == tail) {
+        drain_wake();
+    }
+}
+
+/*
+ * Writes out all lines queued so far, oldest first across threads, then the
+ * counts of suppressed lines, all of them if `all`; returns the count of
+ * lines. Sets `next_ns` to when the next count is due, 0 if none.
+ */
+static int drain(int all, uint64_t *next_ns)
+{
+    int count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    unsigned heads[LOG_THREADS_MAX];
+    int written = 0;
+
+    if (count > LOG_THREADS_MAX) {
+        count = LOG_THREADS_MAX;
+    }
+
+    /* Lines queued after this point wait for the next round, so a busy thread cannot keep it going */
+    for (int i = 0; i < count; i++) {
+        log_ring_t *r = atomic_load_explicit(&rings[i], memory_order_acquire);
+
+        heads[i] = (r != NULL) ? atomic_load_explicit(&r->head, memory_order_acquire) : 0;
+    }
+
+    while (1) {
+        log_ring_t *oldest = NULL;
+        log_line_t *line = NULL;
+
+        for (int i = 0; i < count; i++) {
+            log_ring_t *r = atomic_load_explicit(&rings[i], memory_order_relaxed);
+
+            if (r == NULL) {
+                continue;
+            }
+
+            unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+            if (tail != heads[i] && (line == NULL || r->lines[tail % LOG_RING_SIZE].ts < line->ts)) {
+                oldest = r;
+                line = &r->lines[tail % LOG_RING_SIZE];
+            }
+        }
+
+        if (oldest == NULL) {
+            break;
+        }
+
+        write_line(line->level, line->text);
+        atomic_fetch_add_explicit(&oldest->tail, 1, memory_order_release);
+        written++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        log_ring_t *r = atomic_load_explicit(&rings[i], memory_order_relaxed);
+        unsigned long dropped = (r != NULL) ? atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed) : 0;
+
+        if (dropped > 0) {
+            fprintf(stderr, "[%ld] Log full, %lu lines dropped\n", (long) (time_mono_ns() / NS_PER_S), dropped);
+            written++;
+        }
+    }
+
+    written += limit_sweep(all, next_ns);
+
+    if (written > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    return written;
+}
+
+static void *drain_thread(void *arg)
+{
+    uint64_t next_ns;
+
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        if (drain(0, &next_ns) > 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&drain_lock);
+
+        while (!drain_wanted && atomic_load_explicit(&running, memory_order_acquire)) {
+            if (next_ns == 0) {
+                pthread_cond_wait(&drain_cond, &drain_lock);
+            } else if (deadline_wait(&drain_cond, &drain_lock, next_ns) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        drain_wanted = 0;
+
+        pthread_mutex_unlock(&drain_lock);
+    }
+
+    return NULL;
+}
+
+int log_open(int log_level)
+{
+    if (deadline_cond_init(&drain_cond) != 0) {
+        return -1;
+    }
+
+    atomic_store(&level, log_level);
+    atomic_store(&running, 1);
+
+    if (pthread_create(&drain_tid, NULL, drain_thread, NULL) != 0) {
+        atomic_store(&running, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+void log_close()
+{
+    if (!atomic_load(&running)) {
+        return;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    atomic_store(&running, 0);
+    pthread_cond_signal(&drain_cond);
+    pthread_mutex_unlock(&drain_lock);
+
+    pthread_join(drain_tid, NULL);
+
+    /* Threads still logging now write directly, this catches what they queued before */
+    uint64_t next_ns;
+
+    drain(1, &next_ns);
+
+    int count = atomic_exchange(&ring_count, 0);
+
+    for (int i = 0; i < count && i < LOG_THREADS_MAX; i++) {
+        free(atomic_exchange(&rings[i], NULL));
+    }
+}
+
+/* Lets the drain thread find the limit to write its counts */
+static void limit_register(log_limit_t *limit, const char *fmt, const char *key)
+{
+    int unregistered = 0;
+
+    if (!atomic_compare_exchange_strong(&limit->registered, &unregistered, 1)) {
+        return;
+    }
+
+    limit->fmt = fmt;
+    snprintf(limit->key, LOG_LIMIT_KEY_SIZE, "%s", (key != NULL) ? key : "");
+
+    limit->next = atomic_load_explicit(&limits, memory_order_relaxed);
+
+    while (!atomic_compare_exchange_weak_explicit(&limits, &limit->next, limit,
+        memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+static int limit_pass(log_limit_t *limit, const char *fmt, const char *key)
+{
+    uint64_t now = time_mono_ns();
+
+    if (!atomic_load_explicit(&limit->registered, memory_order_relaxed)) {
+        limit_register(limit, fmt, key);
+    }
+
+    uint_fast64_t start = atomic_load_explicit(&limit->start, memory_order_relaxed);
+
+    if ((start == 0 || now - start >= LOG_LIMIT_PERIOD_NS)
+        && atomic_compare_exchange_strong(&limit->start, &start, now)) {
+        atomic_store(&limit->count, 0);
+
+        unsigned long suppressed = atomic_exchange(&limit->suppressed, 0);
+
+        if (suppressed > 0) {
+            atomic_fetch_add(&limit->pending, suppressed);
+            drain_wake();
+        }
+    }
+
+    if (atomic_fetch_add(&limit->count, 1) < LOG_LIMIT_BURST) {
+        return 1;
+    }
+
+    /* The drain thread learns when to write the count */
+    if (atomic_fetch_add(&limit->suppressed, 1) == 0) {
+        drain_wake();
+    }
+
+    return 0;
+}
+
+/*
+ * Writes the counts of suppressed lines of periods over, or all of them;
+ * returns the count of lines written and sets `next_ns` to the end of the
+ * first period with lines suppressed, 0 if none.
+ */
+static int limit_sweep(int all, uint64_t *next_ns)
+{
+    uint64_t now = time_mono_ns();
+    int written = 0;
+
+    *next_ns = 0;
+
+    for (log_limit_t *limit = atomic_load_explicit(&limits, memory_order_acquire); limit != NULL;
+        limit = limit->next) {
+        unsigned long suppressed = atomic_exchange(&limit->pending, 0);
+        uint64_t end = atomic_load(&limit->start) + LOG_LIMIT_PERIOD_NS;
+
+        if (all || now >= end) {
+            suppressed += atomic_exchange(&limit->suppressed, 0);
+        } else if (atomic_load(&limit->suppressed) > 0 && (*next_ns == 0 || end < *next_ns)) {
+            *next_ns = end;
+        }
+
+        if (suppressed == 0) {
+            continue;
+        }
+
+        /* The constant start of the message */
+        int len = strcspn(limit->fmt, "%\n");
+
+        while (len > 0 && limit->fmt[len - 1] == ' ') {
+            len--;
+        }
+
+        if (limit->key[0] != '\0') {
+            fprintf(stderr, "[%ld] %lu more like: %.*s (%s)\n", (long) (now / NS_PER_S), suppressed,
+                len, limit->fmt, limit->key);
+        } else {
+            fprintf(stderr, "[%ld] %lu more like: %.*s\n", (long) (now / NS_PER_S), suppressed, len, limit->fmt);
+        }
+
+        written++;
+    }
+
+    return written;
+}
+
+int log_limit(log_limit_t *limit, const char *fmt)
+{
+    return limit_pass(limit, fmt, NULL);
+}
+
+/* FNV-1a, never 0 as that marks a free slot */
+static uint64_t key_hash(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (; *key != '\0'; key++) {
+        hash = (hash ^ (uint8_t) *key) * 1099511628211ULL;
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+int log_limit_key(log_limit_set_t *set, const char *key, const char *fmt)
+{
+    uint64_t hash = key_hash(key);
+
+    /* Open addressing, slots are claimed once and never freed */
+    for (int i = 0; i < LOG_LIMIT_KEYS; i++) {
+        int slot = (hash + i) % LOG_LIMIT_KEYS;
+        uint_fast64_t found = atomic_load_explicit(&set->hashes[slot], memory_order_acquire);
+
+        if (found == 0) {
+            uint_fast64_t empty = 0;
+
+            if (atomic_compare_exchange_strong(&set->hashes[slot], &empty, hash)) {
+                return limit_pass(&set->limits[slot], fmt, key);
+            }
+
+            found = empty;
+        }
+
+        if (found == hash) {
+            return limit_pass(&set->limits[slot], fmt, key);
+        }
+    }
+
+    return limit_pass(&set->shared, fmt, NULL);
+}
@@ -0,0 +1,90 @@
+#ifndef __TEMP_LOG_H__
+#define __TEMP_LOG_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+#define LOG_LINE_SIZE 248
+#define LOG_RING_SIZE 256 // Lines per thread, power of two
+#define LOG_THREADS_MAX 64
+
+#define LOG_LIMIT_BURST 5 // Lines of one call site let through per period
+#define LOG_LIMIT_PERIOD_NS (60 * 1000000000ULL)
+#define LOG_LIMIT_KEYS 64 // Keys with a limit of their own per call site
+#define LOG_LIMIT_KEY_SIZE 32 // Longest key shown in the count of suppressed lines + 1
+
+/*
+ * Asynchronous logging. Every thread formats its lines into a ring buffer
+ * of its own, a single producer single consumer queue with no locks, and a
+ * background thread writes them out, merged in time order: errors and
+ * warnings to stderr, the rest to stdout. A thread never waits for the
+ * output; when its ring is full the line is dropped and counted. Lines
+ * above the level are not even formatted. Before log_open() and after
+ * log_close() lines are written directly. The background thread sleeps
+ * while there is nothing to write, a thread wakes it only when its ring
+ * gets a line while empty. log_close() frees the rings, it is called once
+ * the other threads are done.
+ */
+int log_open(int level);
+
+void log_close();
+
+int log_level();
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_error(...) log_write(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_write(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_write(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) do { if (log_level() >= LOG_DEBUG) log_write(LOG_DEBUG, __VA_ARGS__); } while (0)
+
+/*
+ * Rate limit of a call site: LOG_LIMIT_BURST lines per LOG_LIMIT_PERIOD_NS.
+ * The logging thread writes the count of suppressed ones once their period
+ * is over, whether the call site logs again or not, and the rest of them on
+ * log_close().
+ */
+typedef struct log_limit {
+    atomic_uint_fast64_t start;
+    atomic_int count;
+    atomic_ulong suppressed; // In the current period
+    atomic_ulong pending; // Of past periods, not written yet
+
+    /* Set once, on first use, when the limit is registered with the logging thread */
+    atomic_int registered;
+    const char *fmt;
+    char key[LOG_LIMIT_KEY_SIZE];
+    struct log_limit *next;
+} log_limit_t;
+
+int log_limit(log_limit_t *limit, const char *fmt);
+
+#define log_limited(level, fmt, ...) do { \
+        static log_limit_t limit_; \
+        if (log_level() >= (level) && log_limit(&limit_, fmt)) log_write((level), fmt, ##__VA_ARGS__); \
+    } while (0)
+
+/*
+ * Rate limits of a call site kept apart per key, a sensor or a device, so a
+ * failing one does not hide the messages of the others. Keys beyond
+ * LOG_LIMIT_KEYS share one limit.
+ */
+typedef struct log_limit_set {
+    atomic_uint_fast64_t hashes[LOG_LIMIT_KEYS]; // 0 for a free slot
+    log_limit_t limits[LOG_LIMIT_KEYS];
+    log_limit_t shared;
+} log_limit_set_t;
+
+int log_limit_key(log_limit_set_t *set, const char *key, const char *fmt);
+
+#define log_limited_by(level, key, fmt, ...) do { \
+        static log_limit_set_t limits_; \
+        if (log_level() >= (level) && log_limit_key(&limits_, (key), fmt)) log_write((level), fmt, ##__VA_ARGS__); \
+    } while (0)
+
+#endif /* __TEMP_LOG_H__ */
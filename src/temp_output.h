@@ -2,9 +2,30 @@
 #define __TEMP_OUTPUT_H__
 
 #include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
 
-int out_tsv(char *file_name, wire_t *wires, int wire_count);
+/*
+ * A record of Unix socket output, one per sensor, a datagram holds several
+ * of them. Native byte order, the consumer runs on the same host.
+ */
+typedef struct unix_record {
+    uint8_t address[8];
+    uint64_t ts_read; // CLOCK_MONOTONIC of the read, ns
+    float temperature;
+    int32_t status;
+} unix_record_t;
 
-int out_json(char *file_name, wire_t *wires, int wire_count);
+int out_tsv(const char *file_name, const temp_snapshot_t *snap);
+
+int out_json(const char *file_name, const temp_snapshot_t *snap);
+
+extern const temp_sink_api_t tsv_sink;
+
+extern const temp_sink_api_t json_sink;
+
+extern const temp_sink_api_t unix_sink;
+
+extern const temp_sink_api_t binary_sink;
 
 #endif /* __TEMP_OUTPUT_H__ */
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_binary.h"
+
+#define FNAME_SIZE 128
+
+typedef struct binary_ctx {
+    const char *file_name;
+    uint8_t *buf;
+    size_t size;
+} binary_ctx_t;
+
+/* Snapshot encoded in `buf`, replaces the file atomically, as TSV does */
+static int out_binary(const char *file_name, const uint8_t *buf, size_t len)
+{
+    char tmp_name[FNAME_SIZE];
+
+    snprintf(tmp_name, FNAME_SIZE, "%s.tmp", file_name);
+
+    int f = open(tmp_name, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+
+    if (f == -1) {
+        perror("Error creating output file\n");
+        return -1;
+    }
+
+    ssize_t w = write(f, buf, len);
+
+    close(f);
+
+    if (w != (ssize_t) len) {
+        printf("Error writing binary output file\n");
+        return -2;
+    }
+
+    rename(tmp_name, file_name);
+
+    return 0;
+}
+
+static void *binary_open(const char *args)
+{
+    binary_ctx_t *ctx = calloc(1, sizeof(binary_ctx_t));
+
+    if (ctx != NULL) {
+        ctx->file_name = args;
+    }
+
+    return ctx;
+}
+
+static int binary_write(void *ctx_v, const temp_snapshot_t *snap)
+{
+    binary_ctx_t *ctx = ctx_v;
+    size_t len = binary_size(snap->thermo_count);
+
+    /* Buffer only grows, as the count of sensors rarely changes */
+    if (len > ctx->size) {
+        uint8_t *b = realloc(ctx->buf, len);
+
+        if (b == NULL) {
+            return -1;
+        }
+
+        ctx->buf = b;
+        ctx->size = len;
+    }
+
+    len = binary_encode(snap, ctx->buf, ctx->size);
+
+    if (len == 0) {
+        return -1;
+    }
+
+    return out_binary(ctx->file_name, ctx->buf, len);
+}
+
+static void binary_close(void *ctx_v)
+{
+    binary_ctx_t *ctx = ctx_v;
+
+    free(ctx->buf);
+    free(ctx);
+}
+
+const temp_sink_api_t binary_sink = {
+    TEMP_SINK_ABI, "binary", binary_open, binary_write, NULL, binary_close
+};
@@ -2,60 +2,90 @@
 
 #include "dallas.h"
 #include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
 
 #define JDUMP_FLAGS JSON_INDENT(2) | JSON_ESCAPE_SLASH
 #define BUF_SIZE 128
 
-int out_json(char *file_name, wire_t *wires, int wire_count)
+int out_json(const char *file_name, const temp_snapshot_t *snap)
 {
     char output[BUF_SIZE];
 
     json_t *jdev = json_array();
     json_t *jtemp = json_array();
 
-    int t = 0;
-
-    for (int i = 0; i < wire_count; i++) {
+    for (int i = 0; i < snap->wire_count; i++) {
         json_t *jwire = json_object();
 
         json_object_set_new(jwire, "num", json_integer(i));
-        json_object_set_new(jwire, "device", json_string(wires[i].device));
-        json_object_set_new(jwire, "status", json_integer(wires[i].status));
-        json_object_set_new(jwire, "thermo_count", json_integer(wires[i].thermo_count));
+        json_object_set_new(jwire, "device", json_string(snap->wires[i].device));
+        json_object_set_new(jwire, "status", json_integer(snap->wires[i].status));
+        json_object_set_new(jwire, "thermo_count", json_integer(snap->wires[i].thermo_count));
 
-        for (int j = 0; j < wires[i].thermo_count; j++, t++) {
-            json_t *jthermo = json_object();
+        json_array_append_new(jdev, jwire);
+    }
 
-            json_object_set_new(jthermo, "num", json_integer(t));
-            json_object_set_new(jthermo, "device_num", json_integer(i));
-            json_object_set_new(jthermo, "status", json_integer(wires[i].thermometers[j].status));
+    for (int t = 0; t < snap->thermo_count; t++) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        json_t *jthermo = json_object();
 
-            uint8_t *addr = wires[i].thermometers[j].address;
-            uint8_t *scr = wires[i].thermometers[j].scratchpad;
+        json_object_set_new(jthermo, "num", json_integer(t));
+        json_object_set_new(jthermo, "id", json_integer(thermo->id));
+
+        if (thermo->alias != NULL) {
+            json_object_set_new(jthermo, "alias", json_string(thermo->alias));
+        }
 
+        json_object_set_new(jthermo, "device_num", json_integer(thermo->wire_num));
+        json_object_set_new(jthermo, "family", json_string(thermo->family));
+        json_object_set_new(jthermo, "status", json_integer(thermo->status));
+        json_object_set_new(jthermo, "crc_errors", json_integer(thermo->crc_errors));
+        json_object_set_new(jthermo, "read_errors", json_integer(thermo->read_errors));
+        json_object_set_new(jthermo, "fail_streak", json_integer(thermo->fail_streak));
+        json_object_set_new(jthermo, "last_good", json_integer(thermo->last_good));
+        json_object_set_new(jthermo, "quarantine_until", json_integer(thermo->quarantine_until));
+        json_object_set_new(jthermo, "spikes", json_integer(thermo->spikes));
+        json_object_set_new(jthermo, "ts_convert", json_integer(thermo->ts_convert));
+        json_object_set_new(jthermo, "ts_read", json_integer(thermo->ts_read));
+        json_object_set_new(jthermo, "ts_wall", json_integer(thermo->ts_wall));
+
+        const uint8_t *addr = thermo->address;
+        const uint8_t *scr = thermo->scratchpad;
+
+        snprintf(output, BUF_SIZE,
+            "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7]
+        );
+
+        json_object_set_new(jthermo, "address", json_string(output));
+
+        if (thermo->status != TEMP_STATUS_FAIL) {
             snprintf(output, BUF_SIZE,
-                "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-                addr[0], addr[1], addr[2], addr[3],
-                addr[4], addr[5], addr[6], addr[7]
+                "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
+                scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
+                scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC]
             );
 
-            json_object_set_new(jthermo, "address", json_string(output));
+            json_object_set_new(jthermo, "scratchpad", json_string(output));
+            json_object_set_new(jthermo, "temperature", json_real(thermo->temperature));
+        }
 
-            if (wires[i].thermometers[j].status != TEMP_STATUS_FAIL) {
-                snprintf(output, BUF_SIZE,
-                    "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
-                    scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
-                    scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC]
-                );
+        if (snap->window > 0 && thermo->win_count > 0) {
+            json_t *jwin = json_object();
 
-                json_object_set_new(jthermo, "scratchpad", json_string(output));
-                json_object_set_new(jthermo, "temperature", json_real(wires[i].thermometers[j].temperature));
-            }
+            json_object_set_new(jwin, "period", json_integer(snap->window));
+            json_object_set_new(jwin, "min", json_real(thermo->win_min));
+            json_object_set_new(jwin, "max", json_real(thermo->win_max));
+            json_object_set_new(jwin, "mean", json_real(thermo->win_mean));
+            json_object_set_new(jwin, "last", json_real(thermo->win_last));
+            json_object_set_new(jwin, "count", json_integer(thermo->win_count));
 
-            json_array_append_new(jtemp, jthermo);
+            json_object_set_new(jthermo, "window", jwin);
         }
 
-        json_array_append_new(jdev, jwire);
+        json_array_append_new(jtemp, jthermo);
     }
 
     snprintf(output, BUF_SIZE, "%s.tmp", file_name);
@@ -73,3 +103,22 @@ int out_json(char *file_name, wire_t *wires, int wire_count)
 
     return 0;
 }
+
+/* Output file name is the sink context, it lives as long as the daemon */
+static void *json_open(const char *args)
+{
+    return (void *) args;
+}
+
+static int json_write(void *ctx, const temp_snapshot_t *snap)
+{
+    return out_json((const char *) ctx, snap);
+}
+
+static void json_close(void *ctx)
+{
+}
+
+const temp_sink_api_t json_sink = {
+    TEMP_SINK_ABI, "json", json_open, json_write, NULL, json_close
+};
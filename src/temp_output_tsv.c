@@ -4,16 +4,21 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <inttypes.h>
 
 #include "dallas.h"
 #include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
 
 #define DEVICE_HEADER "NUM\tDEVICE\tSTATUS\tTHERMO_COUNT\n"
-#define THERMO_HEADER "\nNUM\tDEVICE_NUM\tADDRESS\tSCRATCHPAD\tTEMPERATURE\n"
-#define BUF_SIZE 88
+#define THERMO_HEADER "\nNUM\tDEVICE_NUM\tADDRESS\tSCRATCHPAD\tTEMPERATURE" \
+    "\tCRC_ERRORS\tREAD_ERRORS\tFAIL_STREAK\tLAST_GOOD\tQUARANTINE_UNTIL\tID\tALIAS\tFAMILY\tSPIKES" \
+    "\tWIN_MIN\tWIN_MAX\tWIN_MEAN\tWIN_LAST\tWIN_COUNT\tTS_CONVERT\tTS_READ\tTS_WALL\n"
+#define BUF_SIZE 512
 #define FNAME_SIZE 128
 
-int out_tsv(char *file_name, wire_t *wires, int wire_count)
+int out_tsv(const char *file_name, const temp_snapshot_t *snap)
 {
     char output[BUF_SIZE];
     char tmp_name[FNAME_SIZE];
@@ -21,7 +26,7 @@ int out_tsv(char *file_name, wire_t *wires, int wire_count)
 
     snprintf(tmp_name, FNAME_SIZE, "%s.tmp", file_name);
 
-    int f = open(tmp_name, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+    int f = open(tmp_name, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
 
     if (f == -1) {
         perror("Error creating output file\n");
@@ -36,10 +41,17 @@ int out_tsv(char *file_name, wire_t *wires, int wire_count)
         return -1;
     }
 
-    for (int i = 0; i < wire_count; i++) {
+    for (int i = 0; i < snap->wire_count; i++) {
         psize = snprintf(output, BUF_SIZE, "%d\t%s\t%d\t%d\n",
-            i, wires[i].device, wires[i].status, wires[i].thermo_count
+            i, snap->wires[i].device, snap->wires[i].status, snap->wires[i].thermo_count
         );
+        /* Never write out more than the buffer holds, nor a cut line */
+        if (psize < 0 || psize >= BUF_SIZE) {
+            printf("Device line too long\n");
+            close(f);
+            return -2;
+        }
+
         w = write(f, output, psize);
 
         if (w == -1) {
@@ -57,35 +69,49 @@ int out_tsv(char *file_name, wire_t *wires, int wire_count)
         return -3;
     }
 
-    int t = 0;
-
-    for (int i = 0; i < wire_count; i++) {
-        for (int j = 0; j < wires[i].thermo_count; j++, t++) {
-            uint8_t *addr = wires[i].thermometers[j].address;
-            uint8_t *scr = wires[i].thermometers[j].scratchpad;
-
-            psize = snprintf(output, BUF_SIZE,
-                
-                "%d\t%d\t"
-                "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X\t"
-                "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X\t"
-                "%.4f\n",
-
-                t, i,
-                addr[0], addr[1], addr[2], addr[3],
-                addr[4], addr[5], addr[6], addr[7],
-                scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
-                scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC],
-                wires[i].thermometers[j].temperature
-            );
-
-            w = write(f, output, psize);
-
-            if (w == -1) {
-                printf("Error writing thermometer line\n");
-                close(f);
-                return -4;
-            }
+    for (int t = 0; t < snap->thermo_count; t++) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        const uint8_t *addr = thermo->address;
+        const uint8_t *scr = thermo->scratchpad;
+
+        psize = snprintf(output, BUF_SIZE,
+            
+            "%d\t%d\t"
+            "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X\t"
+            "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X\t"
+            "%.4f\t"
+            "%lu\t%lu\t%d\t%ld\t%ld\t"
+            "%d\t%s\t%s\t%lu\t"
+            "%.4f\t%.4f\t%.4f\t%.4f\t%d\t"
+            "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+
+            t, thermo->wire_num,
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7],
+            scr[SCR_L], scr[SCR_H], scr[SCR_HI_ALARM], scr[SCR_LO_ALARM], scr[SCR_CFG],
+            scr[SCR_FFH], scr[SCR_RESERVED], scr[SCR_10H], scr[SCR_CRC],
+            thermo->temperature,
+            thermo->crc_errors, thermo->read_errors,
+            thermo->fail_streak, thermo->last_good,
+            thermo->quarantine_until,
+            thermo->id, (thermo->alias != NULL) ? thermo->alias : "",
+            thermo->family, thermo->spikes,
+            thermo->win_min, thermo->win_max, thermo->win_mean, thermo->win_last, thermo->win_count,
+            thermo->ts_convert, thermo->ts_read, thermo->ts_wall
+        );
+
+        if (psize < 0 || psize >= BUF_SIZE) {
+            printf("Thermometer line too long\n");
+            close(f);
+            return -4;
+        }
+
+        w = write(f, output, psize);
+
+        if (w == -1) {
+            printf("Error writing thermometer line\n");
+            close(f);
+            return -4;
         }
     }
     
@@ -95,3 +121,22 @@ int out_tsv(char *file_name, wire_t *wires, int wire_count)
 
     return 0;
 }
+
+/* Output file name is the sink context, it lives as long as the daemon */
+static void *tsv_open(const char *args)
+{
+    return (void *) args;
+}
+
+static int tsv_write(void *ctx, const temp_snapshot_t *snap)
+{
+    return out_tsv((const char *) ctx, snap);
+}
+
+static void tsv_close(void *ctx)
+{
+}
+
+const temp_sink_api_t tsv_sink = {
+    TEMP_SINK_ABI, "tsv", tsv_open, tsv_write, NULL, tsv_close
+};
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_output.h"
+
+/* Records per datagram, more sensors are sent in several datagrams */
+#define UNIX_RECORDS_MAX 64
+
+typedef struct unix_ctx {
+    int fd;
+    struct sockaddr_un addr;
+    unsigned long dropped;
+    unix_record_t records[UNIX_RECORDS_MAX];
+} unix_ctx_t;
+
+/*
+ * Connectionless, so the consumer may come and go. The socket is
+ * non-blocking: if the consumer does not keep up, datagrams are dropped
+ * instead of delaying the next snapshot.
+ */
+static void *unix_open(const char *args)
+{
+    unix_ctx_t *ctx = calloc(1, sizeof(unix_ctx_t));
+
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    if (strlen(args) >= sizeof(ctx->addr.sun_path)) {
+        fprintf(stderr, "Unix socket path too long: %s\n", args);
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (ctx->fd == -1) {
+        perror("Error creating Unix socket");
+        free(ctx);
+        return NULL;
+    }
+
+    fcntl(ctx->fd, F_SETFL, fcntl(ctx->fd, F_GETFL) | O_NONBLOCK);
+
+    ctx->addr.sun_family = AF_UNIX;
+    strcpy(ctx->addr.sun_path, args);
+
+    return ctx;
+}
+
+static int unix_send(unix_ctx_t *ctx, int count)
+{
+    ssize_t s = sendto(ctx->fd, ctx->records, count * sizeof(unix_record_t), 0,
+        (struct sockaddr *) &ctx->addr, sizeof(ctx->addr));
+
+    if (s == -1) {
+        /* No consumer listening or it is behind, both are fine */
+        if (errno == EAGAIN || errno == ENOENT || errno == ECONNREFUSED) {
+            ctx->dropped++;
+            return 0;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unix_write(void *ctx_v, const temp_snapshot_t *snap)
+{
+    unix_ctx_t *ctx = ctx_v;
+    int count = 0;
+
+    for (int t = 0; t < snap->thermo_count; t++) {
+        const temp_reading_t *thermo = &snap->readings[t];
+        unix_record_t *rec = &ctx->records[count++];
+
+        memcpy(rec->address, thermo->address, sizeof(rec->address));
+        rec->ts_read = thermo->ts_read;
+        rec->temperature = thermo->temperature;
+        rec->status = thermo->status;
+
+        if (count == UNIX_RECORDS_MAX) {
+            if (unix_send(ctx, count) != 0) {
+                return -1;
+            }
+
+            count = 0;
+        }
+    }
+
+    if (count > 0) {
+        return unix_send(ctx, count);
+    }
+
+    return 0;
+}
+
+static void unix_close(void *ctx_v)
+{
+    unix_ctx_t *ctx = ctx_v;
+
+    if (ctx->dropped > 0) {
+        printf("Unix socket %s: %lu datagrams dropped\n", ctx->addr.sun_path, ctx->dropped);
+    }
+
+    close(ctx->fd);
+    free(ctx);
+}
+
+const temp_sink_api_t unix_sink = {
+    TEMP_SINK_ABI, "unix", unix_open, unix_write, NULL, unix_close
+};
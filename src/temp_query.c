@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <jansson.h>
+
+#include "temp_types.h"
+#include "temp_time.h"
+#include "temp_log.h"
+#include "temp_registry.h"
+#include "temp_query.h"
+#include "mqtt_output.h"
+
+#define QUERY_POLL_MS 200 // How often the listener looks whether to stop
+#define QUERY_PAYLOAD_SIZE 384
+#define QUERY_JSON_FLAGS (JSON_COMPACT | JSON_REAL_PRECISION(7)) // Floats have no more digits
+
+typedef struct query {
+    char name[QUERY_NAME_SIZE];
+    unsigned long seq;
+    int owner; // Wire to read the sensor, or to answer it was not found; -1 until known
+    thermometer_t *thermo; // NULL if not found
+    int misses; // Wires which do not have the sensor
+    int started;
+    int mqtt; // Answer to MQTT too
+    int waiter_count;
+    struct sockaddr_un waiters[QUERY_WAITERS_MAX];
+    socklen_t waiter_len[QUERY_WAITERS_MAX];
+    struct query *next;
+} query_t;
+
+static pthread_mutex_t query_lock = PTHREAD_MUTEX_INITIALIZER;
+static query_t *pending = NULL;
+static int pending_count = 0;
+static unsigned long last_seq = 0;
+
+static int wires = 0;
+static void (*wake_wires)() = NULL;
+static query_read_t read_sensor = NULL;
+
+static int fd = -1;
+static char *path = NULL;
+static atomic_int listening = 0;
+static pthread_t listener_tid;
+
+static json_t *answer_new(const char *request, const char *status)
+{
+    json_t *janswer = json_object();
+
+    if (request != NULL) {
+        json_object_set_new(janswer, "request", json_string(request));
+    }
+
+    json_object_set_new(janswer, "status", json_string(status));
+
+    return janswer;
+}
+
+/* Dumps and releases the answer, 0 if it does not fit */
+static size_t answer_dump(json_t *janswer, char *payload)
+{
+    size_t len = json_dumpb(janswer, payload, QUERY_PAYLOAD_SIZE - 1, QUERY_JSON_FLAGS);
+
+    json_decref(janswer);
+
+    if (len == 0 || len >= QUERY_PAYLOAD_SIZE) {
+        log_limited(LOG_ERROR, "Read request answer does not fit into %d bytes, not sent\n", QUERY_PAYLOAD_SIZE);
+        return 0;
+    }
+
+    payload[len] = '\0';
+
+    return len;
+}
+
+static void answer_to(const struct sockaddr_un *to, socklen_t to_len, const char *payload, size_t len)
+{
+    if (sendto(fd, payload, len, 0, (const struct sockaddr *) to, to_len) == -1
+        && errno != EAGAIN && errno != ENOENT && errno != ECONNREFUSED) {
+        log_limited(LOG_WARN, "Error answering read request: %s\n", strerror(errno));
+    }
+}
+
+static void submit(const char *name, const struct sockaddr_un *from, socklen_t from_len, int mqtt)
+{
+    query_t *q;
+    int created = 0;
+
+    pthread_mutex_lock(&query_lock);
+
+    /* Coalesce with a request for the same sensor which is not being read yet */
+    for (q = pending; q != NULL; q = q->next) {
+        if (!q->started && strcmp(q->name, name) == 0) {
+            break;
+        }
+    }
+
+    if (q == NULL) {
+        if (pending_count >= QUERY_PENDING_MAX || (q = calloc(1, sizeof(query_t))) == NULL) {
+            pthread_mutex_unlock(&query_lock);
+            log_limited(LOG_WARN, "Too many on-demand reads pending, request for %s dropped\n", name);
+            return;
+        }
+
+        snprintf(q->name, QUERY_NAME_SIZE, "%s", name);
+        q->seq = ++last_seq;
+        q->owner = -1;
+
+        query_t **tail = &pending;
+
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+
+        *tail = q;
+        pending_count++;
+        created = 1;
+    }
+
+    /* An unbound requester has no address to answer to */
+    if (from != NULL && from_len > sizeof(sa_family_t) && q->waiter_count < QUERY_WAITERS_MAX) {
+        q->waiters[q->waiter_count] = *from;
+        q->waiter_len[q->waiter_count] = from_len;
+        q->waiter_count++;
+    }
+
+    q->mqtt |= mqtt;
+
+    pthread_mutex_unlock(&query_lock);
+
+    if (created) {
+        wake_wires();
+    }
+}
+
+/*
+ * Sensor names end at the first blank, e.g. a newline sent along by socat.
+ * A ROM in hex or an alias has only characters aliases may have, anything
+ * else is refused before it gets anywhere near a log line or an answer.
+ */
+static void submit_name(const char *data, int len, const struct sockaddr_un *from, socklen_t from_len, int mqtt)
+{
+    char name[QUERY_NAME_SIZE];
+    char payload[QUERY_PAYLOAD_SIZE];
+    int n = 0;
+
+    while (n < len && data[n] != '\0' && !isspace((unsigned char) data[n])) {
+        if (n >= QUERY_NAME_SIZE - 1 || !registry_alias_char((unsigned char) data[n])) {
+            log_limited(LOG_WARN, "Invalid sensor name in read request, dropped\n");
+
+            size_t payload_len = answer_dump(answer_new(NULL, "invalid name"), payload);
+
+            if (payload_len > 0 && from != NULL && from_len > sizeof(sa_family_t)) {
+                answer_to(from, from_len, payload, payload_len);
+            }
+
+            if (payload_len > 0 && mqtt) {
+                mqtt_read_result(payload);
+            }
+
+            return;
+        }
+
+        name[n] = data[n];
+        n++;
+    }
+
+    name[n] = '\0';
+
+    if (n > 0) {
+        submit(name, from, from_len, mqtt);
+    }
+}
+
+void query_mqtt(const char *name, int len)
+{
+    submit_name(name, len, NULL, 0, 1);
+}
+
+static void *listener_thread(void *arg)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char data[QUERY_NAME_SIZE];
+
+    while (listening) {
+        if (poll(&pfd, 1, QUERY_POLL_MS) <= 0) {
+            continue;
+        }
+
+        struct sockaddr_un from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(fd, data, sizeof(data), 0, (struct sockaddr *) &from, &from_len);
+
+        if (len > 0) {
+            submit_name(data, len, &from, from_len, 0);
+        }
+    }
+
+    return NULL;
+}
+
+int query_open(const char *socket_path, int mqtt, int wire_count, void (*wake)(), query_read_t read)
+{
+    struct sockaddr_un addr;
+
+    wires = wire_count;
+    wake_wires = wake;
+    read_sensor = read;
+
+    if (mqtt) {
+        mqtt_on_read(query_mqtt);
+    }
+
+    if (socket_path == NULL) {
+        return 0;
+    }
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Unix socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (fd == -1) {
+        perror("Error creating read request socket");
+        return -1;
+    }
+
+    /* Answers are sent by wire threads, which must not wait for a slow requester */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    /* Left over by a previous run */
+    unlink(socket_path);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("Error binding read request socket");
+        close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    path = malloc(strlen(socket_path) + 1);
+
+    if (path != NULL) {
+        strcpy(path, socket_path);
+    }
+
+    listening = 1;
+
+    if (pthread_create(&listener_tid, NULL, listener_thread, NULL) != 0) {
+        listening = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void query_close()
+{
+    if (listening) {
+        listening = 0;
+        pthread_join(listener_tid, NULL);
+    }
+
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    if (path != NULL) {
+        unlink(path);
+        free(path);
+        path = NULL;
+    }
+
+    pthread_mutex_lock(&query_lock);
+
+    while (pending != NULL) {
+        query_t *q = pending;
+        pending = q->next;
+        free(q);
+    }
+
+    pending_count = 0;
+
+    pthread_mutex_unlock(&query_lock);
+}
+
+static thermometer_t *find_sensor(wire_t *wire, const char *name)
+{
+    for (int i = 0; i < wire->thermo_count; i++) {
+        thermometer_t *thermo = wire->thermometers[i];
+        const uint8_t *a = thermo->address;
+        char rom[17];
+
+        /* Moved to another wire, which reads it now */
+        if (thermo->wire_num != wire->num) {
+            continue;
+        }
+
+        snprintf(rom, sizeof(rom), "%02X%02X%02X%02X%02X%02X%02X%02X", a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+        if (strcasecmp(rom, name) == 0 || (thermo->alias != NULL && strcmp(thermo->alias, name) == 0)) {
+            return thermo;
+        }
+    }
+
+    return NULL;
+}
+
+static query_t *next_owned(wire_t *wire)
+{
+    for (query_t *q = pending; q != NULL; q = q->next) {
+        if (q->owner == wire->num && !q->started) {
+            return q;
+        }
+    }
+
+    return NULL;
+}
+
+int query_waiting(wire_t *wire)
+{
+    pthread_mutex_lock(&query_lock);
+    int waiting = (wire->query_seen != last_seq) || next_owned(wire) != NULL;
+    pthread_mutex_unlock(&query_lock);
+
+    return waiting;
+}
+
+static void answer(query_t *q, const char *payload, size_t len)
+{
+    for (int i = 0; i < q->waiter_count; i++) {
+        answer_to(&q->waiters[i], q->waiter_len[i], payload, len);
+    }
+
+    if (q->mqtt) {
+        mqtt_read_result(payload);
+    }
+}
+
+void query_serve(wire_t *wire)
+{
+    char payload[QUERY_PAYLOAD_SIZE];
+
+    pthread_mutex_lock(&query_lock);
+
+    for (query_t *q = pending; q != NULL; q = q->next) {
+        if (q->seq <= wire->query_seen || q->owner >= 0) {
+            continue;
+        }
+
+        q->thermo = find_sensor(wire, q->name);
+
+        /* Whichever wire is the last to look answers that no wire has the sensor */
+        if (q->thermo != NULL || ++q->misses >= wires) {
+            q->owner = wire->num;
+        }
+    }
+
+    wire->query_seen = last_seq;
+
+    query_t *q = next_owned(wire);
+
+    if (q != NULL) {
+        q->started = 1;
+    }
+
+    pthread_mutex_unlock(&query_lock);
+
+    if (q == NULL) {
+        return;
+    }
+
+    /* No more waiters are added once started */
+    thermometer_t *thermo = q->thermo;
+    float temperature;
+    json_t *janswer;
+
+    if (thermo == NULL) {
+        janswer = answer_new(q->name, "not found");
+    } else if (read_sensor(wire, thermo, &temperature) != 0) {
+        janswer = answer_new(q->name, "failed");
+    } else {
+        const uint8_t *a = thermo->address;
+        char rom[17];
+
+        snprintf(rom, sizeof(rom), "%02X%02X%02X%02X%02X%02X%02X%02X", a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+        janswer = answer_new(q->name, "ok");
+        json_object_set_new(janswer, "address", json_string(rom));
+        json_object_set_new(janswer, "id", json_integer(thermo->id));
+        json_object_set_new(janswer, "alias", json_string((thermo->alias != NULL) ? thermo->alias : ""));
+        json_object_set_new(janswer, "temperature", json_real(temperature));
+        json_object_set_new(janswer, "ts_read", json_integer(time_mono_ns()));
+        json_object_set_new(janswer, "ts_wall", json_integer(time_wall_ns()));
+    }
+
+    size_t len = answer_dump(janswer, payload);
+
+    if (len > 0) {
+        answer(q, payload, len);
+        log_debug("On-demand read of %s @ %s: %s\n", q->name, wire->device, payload);
+    }
+
+    pthread_mutex_lock(&query_lock);
+
+    for (query_t **p = &pending; *p != NULL; p = &(*p)->next) {
+        if (*p == q) {
+            *p = q->next;
+            pending_count--;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&query_lock);
+
+    free(q);
+}
@@ -0,0 +1,38 @@
+#ifndef __TEMP_QUERY_H__
+#define __TEMP_QUERY_H__
+
+#include "temp_types.h"
+
+#define QUERY_NAME_SIZE 64
+#define QUERY_WAITERS_MAX 16 // Requesters answered by one read
+#define QUERY_PENDING_MAX 64
+
+/*
+ * On-demand reads of a single sensor. A request names a sensor by its ROM
+ * (hex, as in the registry) or alias and comes either as a datagram to the
+ * Unix socket bound by the daemon, answered to the address it came from,
+ * or to the MQTT topic <topic>/read, answered to <topic>/read/result.
+ *
+ * The wire thread owning the sensor converts and reads it between read
+ * cycles, never in the middle of one. Requests for the same sensor which
+ * arrive before its read has started are answered by that one read.
+ */
+
+/* Converts and reads the sensor, 0 when read */
+typedef int (*query_read_t)(wire_t *wire, thermometer_t *thermo, float *temperature);
+
+/* `wake` wakes up wire threads waiting for the next cycle, to look at a new request */
+int query_open(const char *socket_path, int mqtt, int wire_count, void (*wake)(), query_read_t read);
+
+void query_close();
+
+/* Request from MQTT, `name` is not terminated */
+void query_mqtt(const char *name, int len);
+
+/* Whether the wire thread has a request to look at, called under the lock of wire threads */
+int query_waiting(wire_t *wire);
+
+/* Looks at new requests and serves at most one for sensors of the wire */
+void query_serve(wire_t *wire);
+
+#endif /* __TEMP_QUERY_H__ */
@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "ow_driver_linux_usart.h"
+#include "temp_time.h"
+#include "temp_record.h"
+#include "temp_deadline.h"
+
+#define MODE_OFF 0
+#define MODE_RECORD 1
+#define MODE_REPLAY 2
+
+#define STREAM_STEP 1024
+
+typedef struct record {
+    uint8_t op;
+    uint8_t data;
+    int8_t status;
+} record_t;
+
+typedef struct adapter {
+    char *device;
+    ow_driver_ptr driver; // Driver while recording, token while replaying
+
+    /* Recorded operations of the adapter, while replaying */
+    record_t *stream;
+    long stream_count;
+    long stream_max;
+    long cursor;
+} adapter_t;
+
+static int mode = MODE_OFF;
+static FILE *file = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static adapter_t adapters[RECORD_ADAPTERS_MAX];
+static int adapter_count = 0;
+static uint8_t tokens[RECORD_ADAPTERS_MAX]; // Replayed drivers point here
+
+static uint64_t last_ns = 0;
+static unsigned long records = 0;
+static unsigned long diverged = 0;
+static int finished = 0;
+
+/* The driver itself, the linker resolves these to the original functions */
+int __real_init_driver_linux_usart(ow_driver_ptr *d, char *device);
+int __real_release_driver(ow_driver_ptr *d);
+int __real_ow_reset(ow_driver_ptr d);
+int __real_ow_read_bit(ow_driver_ptr d, uint8_t *rbit);
+int __real_ow_write_bit(ow_driver_ptr d, uint8_t wbit);
+int __real_ow_read_byte(ow_driver_ptr d, uint8_t *rbyte);
+int __real_ow_write_byte(ow_driver_ptr d, uint8_t wbyte);
+
+int record_open(const char *file_name)
+{
+    uint8_t header[RECORD_HEADER_SIZE] = RECORD_MAGIC;
+
+    header[sizeof(RECORD_MAGIC) - 1] = RECORD_VERSION;
+
+    file = fopen(file_name, "wb");
+
+    if (file == NULL) {
+        perror("Error creating recording");
+        return -1;
+    }
+
+    if (fwrite(header, RECORD_HEADER_SIZE, 1, file) != 1) {
+        fclose(file);
+        file = NULL;
+        return -1;
+    }
+
+    last_ns = time_mono_ns();
+    mode = MODE_RECORD;
+
+    return 0;
+}
+
+static adapter_t *adapter_add(const char *device)
+{
+    if (adapter_count >= RECORD_ADAPTERS_MAX) {
+        fprintf(stderr, "Too many adapters to record, at most %d supported.\n", RECORD_ADAPTERS_MAX);
+        return NULL;
+    }
+
+    adapter_t *a = &adapters[adapter_count];
+
+    memset(a, 0, sizeof(adapter_t));
+    a->device = malloc(strlen(device) + 1);
+
+    if (a->device == NULL) {
+        return NULL;
+    }
+
+    strcpy(a->device, device);
+
+    adapter_count++;
+
+    return a;
+}
+
+static adapter_t *adapter_by_device(const char *device)
+{
+    for (int i = 0; i < adapter_count; i++) {
+        if (strcmp(adapters[i].device, device) == 0) {
+            return &adapters[i];
+        }
+    }
+
+    return NULL;
+}
+
+static adapter_t *adapter_by_driver(ow_driver_ptr d)
+{
+    for (int i = 0; i < adapter_count; i++) {
+        if (adapters[i].driver == d) {
+            return &adapters[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int stream_append(adapter_t *a, uint8_t op, uint8_t data, int8_t status)
+{
+    if (a->stream_count >= a->stream_max) {
+        record_t *s = realloc(a->stream, (a->stream_max + STREAM_STEP) * sizeof(record_t));
+
+        if (s == NULL) {
+            return -1;
+        }
+
+        a->stream = s;
+        a->stream_max += STREAM_STEP;
+    }
+
+    a->stream[a->stream_count++] = (record_t) { op, data, status };
+
+    return 0;
+}
+
+/*
+ * Load the whole recording, split into streams of adapters. Every adapter
+ * is replayed independently, so wire threads do not depend on each other's
+ * timing.
+ */
+int replay_open(const char *file_name)
+{
+    uint8_t header[RECORD_HEADER_SIZE];
+    uint8_t r[RECORD_SIZE];
+    char device[256];
+
+    FILE *f = fopen(file_name, "rb");
+
+    if (f == NULL) {
+        perror("Error opening recording");
+        return -1;
+    }
+
+    if (fread(header, RECORD_HEADER_SIZE, 1, f) != 1
+        || memcmp(header, RECORD_MAGIC, sizeof(RECORD_MAGIC) - 1) != 0
+        || header[sizeof(RECORD_MAGIC) - 1] != RECORD_VERSION) {
+        fprintf(stderr, "%s is not a recording of version %d\n", file_name, RECORD_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    while (fread(r, RECORD_SIZE, 1, f) == 1) {
+        if (r[0] > adapter_count || (r[0] == adapter_count && r[1] != RECORD_OP_OPEN)) {
+            break;
+        }
+
+        if (r[1] == RECORD_OP_OPEN) {
+            if (fread(device, r[2], 1, f) != 1) {
+                break;
+            }
+
+            device[r[2]] = 0;
+
+            if (r[0] == adapter_count && adapter_add(device) == NULL) {
+                break;
+            }
+        }
+
+        if (stream_append(&adapters[r[0]], r[1], r[2], (int8_t) r[3]) != 0) {
+            break;
+        }
+
+        records++;
+    }
+
+    if (!feof(f)) {
+        fprintf(stderr, "Recording %s is corrupt after %lu operations\n", file_name, records);
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+
+    for (int i = 0; i < adapter_count; i++) {
+        adapters[i].driver = (ow_driver_ptr) &tokens[i];
+    }
+
+    mode = MODE_REPLAY;
+
+    return 0;
+}
+
+int replay_active()
+{
+    return mode == MODE_REPLAY;
+}
+
+/* Set once an adapter has run out of recorded operations */
+int replay_finished()
+{
+    pthread_mutex_lock(&lock);
+    int f = finished;
+    pthread_mutex_unlock(&lock);
+
+    return f;
+}
+
+/* Called with the lock held */
+static void record_write(int adapter, uint8_t op, uint8_t data, int status, const char *device)
+{
+    uint64_t now = time_mono_ns();
+    uint64_t delta = (now - last_ns) / 1000;
+
+    if (delta > UINT32_MAX) {
+        delta = UINT32_MAX;
+    }
+
+    uint8_t r[RECORD_SIZE] = {
+        adapter, op, data, (uint8_t) status,
+        delta & 0xFF, (delta >> 8) & 0xFF, (delta >> 16) & 0xFF, (delta >> 24) & 0xFF
+    };
+
+    last_ns = now;
+
+    fwrite(r, RECORD_SIZE, 1, file);
+
+    if (device != NULL) {
+        fwrite(device, data, 1, file);
+    }
+
+    records++;
+}
+
+static void record_op(ow_driver_ptr d, uint8_t op, uint8_t data, int status)
+{
+    if (deadline_stalled()) {
+        status = RECORD_STATUS_STALLED;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    adapter_t *a = adapter_by_driver(d);
+
+    if (a != NULL) {
+        record_write(a - adapters, op, data, status, NULL);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Next recorded operation of the adapter. Reads get the recorded data,
+ * writes are compared with it: if the daemon asks for something else than
+ * it did while recording (e.g. other options), replay goes on, but counts
+ * the divergence.
+ */
+static int replay_op(adapter_t *a, uint8_t op, uint8_t *data)
+{
+    if (a == NULL) {
+        return OW_ERR;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    if (a->cursor >= a->stream_count) {
+        finished = 1;
+        pthread_mutex_unlock(&lock);
+        return OW_ERR;
+    }
+
+    record_t *r = &a->stream[a->cursor++];
+
+    if (r->op != op || ((op == RECORD_OP_WRITE_BIT || op == RECORD_OP_WRITE_BYTE) && r->data != *data)) {
+        if (diverged++ == 0) {
+            fprintf(stderr, "Replay of %s diverged from recording at operation %ld\n", a->device, a->cursor);
+        }
+    }
+
+    if (op == RECORD_OP_READ_BIT || op == RECORD_OP_READ_BYTE || op == RECORD_OP_DEADLINE) {
+        *data = r->data;
+    }
+
+    int status = r->status;
+
+    pthread_mutex_unlock(&lock);
+
+    if (status == RECORD_STATUS_STALLED) {
+        deadline_stall();
+    }
+
+    if (status == RECORD_STATUS_CANCELLED || status == RECORD_STATUS_STALLED) {
+        deadline_cancel();
+        return OW_ERR;
+    }
+
+    return status;
+}
+
+static adapter_t *replay_adapter(ow_driver_ptr d)
+{
+    ptrdiff_t i = (uint8_t *) d - tokens;
+
+    return (i >= 0 && i < adapter_count) ? &adapters[i] : NULL;
+}
+
+/* Operation refused as the deadline of the thread has passed, recorded so replay cancels at the same point */
+static int cancel_op(ow_driver_ptr d, uint8_t op, uint8_t data)
+{
+    if (mode == MODE_RECORD) {
+        record_op(d, op, data, RECORD_STATUS_CANCELLED);
+    }
+
+    return OW_ERR;
+}
+
+/*
+ * Whether the deadline of the calling thread leaves more than `ns` for the
+ * next step of the cycle, cancelling the thread if not. Threads without a
+ * deadline are always allowed and nothing is recorded for them.
+ */
+int record_deadline_allows(ow_driver_ptr d, uint64_t ns)
+{
+    uint8_t allows = 1;
+
+    if (mode == MODE_REPLAY) {
+        adapter_t *a = replay_adapter(d);
+
+        pthread_mutex_lock(&lock);
+        int recorded = a != NULL && a->cursor < a->stream_count && a->stream[a->cursor].op == RECORD_OP_DEADLINE;
+        pthread_mutex_unlock(&lock);
+
+        if (recorded) {
+            replay_op(a, RECORD_OP_DEADLINE, &allows);
+        }
+    } else {
+        uint64_t left = deadline_left();
+
+        if (left == UINT64_MAX) {
+            return 1;
+        }
+
+        allows = left > ns;
+
+        if (mode == MODE_RECORD) {
+            record_op(d, RECORD_OP_DEADLINE, allows, OW_OK);
+        }
+    }
+
+    if (!allows) {
+        deadline_cancel();
+    }
+
+    return allows;
+}
+
+/* Write out buffered records, e.g. after each read cycle */
+void record_flush()
+{
+    if (mode == MODE_RECORD) {
+        pthread_mutex_lock(&lock);
+        fflush(file);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void record_close(int verbose)
+{
+    if (mode == MODE_RECORD) {
+        fclose(file);
+        file = NULL;
+
+        if (verbose) {
+            printf("Recorded %lu operations of %d adapters\n", records, adapter_count);
+        }
+    } else if (mode == MODE_REPLAY) {
+        printf("Replayed %lu operations of %d adapters, %lu diverged\n", records, adapter_count, diverged);
+    }
+
+    for (int i = 0; i < adapter_count; i++) {
+        free(adapters[i].device);
+        free(adapters[i].stream);
+    }
+
+    adapter_count = 0;
+    mode = MODE_OFF;
+}
+
+int __wrap_init_driver_linux_usart(ow_driver_ptr *d, char *device)
+{
+    uint8_t data = 0;
+    int status;
+
+    switch (mode) {
+        case MODE_RECORD:
+            status = __real_init_driver_linux_usart(d, device);
+
+            pthread_mutex_lock(&lock);
+
+            adapter_t *a = adapter_by_device(device);
+
+            if (a == NULL) {
+                a = adapter_add(device);
+            }
+
+            if (a != NULL) {
+                a->driver = (status == OW_OK) ? *d : NULL;
+                record_write(a - adapters, RECORD_OP_OPEN, strlen(device), status, device);
+            }
+
+            pthread_mutex_unlock(&lock);
+
+            return status;
+
+        case MODE_REPLAY:
+            pthread_mutex_lock(&lock);
+            adapter_t *r = adapter_by_device(device);
+            pthread_mutex_unlock(&lock);
+
+            if (r == NULL) {
+                fprintf(stderr, "No recording of device %s\n", device);
+                return OW_ERR;
+            }
+
+            status = replay_op(r, RECORD_OP_OPEN, &data);
+
+            if (status == OW_OK) {
+                *d = r->driver;
+            }
+
+            return status;
+
+        default:
+            return __real_init_driver_linux_usart(d, device);
+    }
+}
+
+int __wrap_release_driver(ow_driver_ptr *d)
+{
+    uint8_t data = 0;
+    ow_driver_ptr driver = *d;
+    int status;
+
+    switch (mode) {
+        case MODE_RECORD:
+            status = __real_release_driver(d);
+
+            pthread_mutex_lock(&lock);
+
+            adapter_t *a = adapter_by_driver(driver);
+
+            if (a != NULL) {
+                record_write(a - adapters, RECORD_OP_RELEASE, 0, status, NULL);
+                a->driver = NULL;
+            }
+
+            pthread_mutex_unlock(&lock);
+
+            return status;
+
+        case MODE_REPLAY:
+            *d = NULL;
+            return replay_op(replay_adapter(driver), RECORD_OP_RELEASE, &data);
+
+        default:
+            return __real_release_driver(d);
+    }
+}
+
+int __wrap_ow_reset(ow_driver_ptr d)
+{
+    uint8_t data = 0;
+
+    if (mode == MODE_REPLAY) {
+        return replay_op(replay_adapter(d), RECORD_OP_RESET, &data);
+    }
+
+    if (deadline_passed()) {
+        return cancel_op(d, RECORD_OP_RESET, 0);
+    }
+
+    if (mode == MODE_OFF) {
+        return __real_ow_reset(d);
+    }
+
+    int status = __real_ow_reset(d);
+    record_op(d, RECORD_OP_RESET, 0, status);
+
+    return status;
+}
+
+int __wrap_ow_read_bit(ow_driver_ptr d, uint8_t *rbit)
+{
+    if (mode == MODE_REPLAY) {
+        return replay_op(replay_adapter(d), RECORD_OP_READ_BIT, rbit);
+    }
+
+    if (deadline_passed()) {
+        return cancel_op(d, RECORD_OP_READ_BIT, 0);
+    }
+
+    if (mode == MODE_OFF) {
+        return __real_ow_read_bit(d, rbit);
+    }
+
+    int status = __real_ow_read_bit(d, rbit);
+    record_op(d, RECORD_OP_READ_BIT, *rbit, status);
+
+    return status;
+}
+
+int __wrap_ow_write_bit(ow_driver_ptr d, uint8_t wbit)
+{
+    if (mode == MODE_REPLAY) {
+        return replay_op(replay_adapter(d), RECORD_OP_WRITE_BIT, &wbit);
+    }
+
+    if (deadline_passed()) {
+        return cancel_op(d, RECORD_OP_WRITE_BIT, wbit);
+    }
+
+    if (mode == MODE_OFF) {
+        return __real_ow_write_bit(d, wbit);
+    }
+
+    int status = __real_ow_write_bit(d, wbit);
+    record_op(d, RECORD_OP_WRITE_BIT, wbit, status);
+
+    return status;
+}
+
+int __wrap_ow_read_byte(ow_driver_ptr d, uint8_t *rbyte)
+{
+    if (mode == MODE_REPLAY) {
+        return replay_op(replay_adapter(d), RECORD_OP_READ_BYTE, rbyte);
+    }
+
+    if (deadline_passed()) {
+        return cancel_op(d, RECORD_OP_READ_BYTE, 0);
+    }
+
+    if (mode == MODE_OFF) {
+        return __real_ow_read_byte(d, rbyte);
+    }
+
+    int status = __real_ow_read_byte(d, rbyte);
+    record_op(d, RECORD_OP_READ_BYTE, *rbyte, status);
+
+    return status;
+}
+
+int __wrap_ow_write_byte(ow_driver_ptr d, uint8_t wbyte)
+{
+    if (mode == MODE_REPLAY) {
+        return replay_op(replay_adapter(d), RECORD_OP_WRITE_BYTE, &wbyte);
+    }
+
+    if (deadline_passed()) {
+        return cancel_op(d, RECORD_OP_WRITE_BYTE, wbyte);
+    }
+
+    if (mode == MODE_OFF) {
+        return __real_ow_write_byte(d, wbyte);
+    }
+
+    int status = __real_ow_write_byte(d, wbyte);
+    record_op(d, RECORD_OP_WRITE_BYTE, wbyte, status);
+
+    return status;
+}
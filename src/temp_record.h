@@ -0,0 +1,65 @@
+#ifndef __TEMP_RECORD_H__
+#define __TEMP_RECORD_H__
+
+#include <stdint.h>
+
+#include "onewire.h"
+
+/*
+ * Record and replay of 1-Wire traffic. The daemon is linked with the driver
+ * functions wrapped (see WRAP_FLAGS in Makefile), so every reset, bit and
+ * byte the upper layers exchange with USART adapters passes through here.
+ *
+ * While recording, each operation is appended to a binary file along with
+ * its result. While replaying, no adapter is opened at all: operations are
+ * answered from the file, adapter by adapter, in recorded order, so search,
+ * conversions and scratchpad reads (CRC errors included) run as captured.
+ *
+ * File is a header, RECORD_MAGIC and version, followed by 8 byte records:
+ *
+ *   adapter (1), operation (1), data (1), status (1), delta (4, LE, us)
+ *
+ * Delta is the time since the previous record in the file. An OPEN record
+ * is followed by `data` bytes of adapter's device name; adapters are
+ * numbered in the order they are first opened.
+ *
+ * The wrapped calls also enforce deadlines of wire threads (temp_deadline.h).
+ * An operation refused for a passed deadline is recorded with status
+ * RECORD_STATUS_CANCELLED, one of a thread kicked out of the driver with
+ * RECORD_STATUS_STALLED; replay cancels or stalls the thread at the same
+ * point. Decisions taken on the clock of the deadline are recorded as
+ * DEADLINE operations, so replay takes them the same way.
+ */
+#define RECORD_MAGIC "OWREC"
+#define RECORD_VERSION 1
+#define RECORD_HEADER_SIZE 8
+#define RECORD_SIZE 8
+#define RECORD_ADAPTERS_MAX 32
+
+#define RECORD_OP_OPEN 1
+#define RECORD_OP_RELEASE 2
+#define RECORD_OP_RESET 3
+#define RECORD_OP_READ_BIT 4
+#define RECORD_OP_WRITE_BIT 5
+#define RECORD_OP_READ_BYTE 6
+#define RECORD_OP_WRITE_BYTE 7
+#define RECORD_OP_DEADLINE 8
+
+#define RECORD_STATUS_CANCELLED -100
+#define RECORD_STATUS_STALLED -101
+
+int record_open(const char *file_name);
+
+int replay_open(const char *file_name);
+
+int replay_active();
+
+int replay_finished();
+
+int record_deadline_allows(ow_driver_ptr d, uint64_t ns);
+
+void record_flush();
+
+void record_close(int verbose);
+
+#endif /* __TEMP_RECORD_H__ */
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "temp_types.h"
+#include "temp_registry.h"
+
+#define REGISTRY_INITIAL_SIZE 64 // Must be power of two
+#define REGISTRY_LINE_SIZE 256
+#define REGISTRY_UNSAVED_STEP 16
+
+/*
+ * Open addressing hash table with linear probing. Slots keep pointers to
+ * separately allocated sensor records, so growing the table moves only the
+ * pointers and records handed out stay valid. ROM 0 marks an empty slot, as
+ * family code 0 is not used by any device.
+ */
+typedef struct registry_slot {
+    uint64_t rom;
+    thermometer_t *thermo;
+} registry_slot_t;
+
+static registry_slot_t *slots = NULL;
+static uint32_t slot_mask = 0;
+static int count = 0;
+static int next_id = 1;
+
+static const char *file_name = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* New sensors not written to the file yet, see registry_flush() */
+static thermometer_t **unsaved = NULL;
+static int unsaved_count = 0;
+static int unsaved_max = 0;
+
+static uint64_t rom_key(const uint8_t *address);
+static uint32_t rom_hash(uint64_t rom);
+static registry_slot_t *registry_find(uint64_t rom);
+static thermometer_t *registry_insert(uint64_t rom, const uint8_t *address, int id, const char *alias);
+static int registry_grow();
+static int registry_load();
+static void registry_alias_clean(char *alias, int line_num);
+static void registry_append(thermometer_t *thermo);
+static thermometer_t *registry_find_id(int id);
+
+int registry_init(const char *name)
+{
+    slots = calloc(REGISTRY_INITIAL_SIZE, sizeof(registry_slot_t));
+
+    if (slots == NULL) {
+        return -1;
+    }
+
+    slot_mask = REGISTRY_INITIAL_SIZE - 1;
+    file_name = name;
+
+    if (file_name != NULL) {
+        return registry_load();
+    }
+
+    return 0;
+}
+
+void registry_release()
+{
+    registry_flush();
+
+    for (uint32_t i = 0; slots != NULL && i <= slot_mask; i++) {
+        if (slots[i].thermo != NULL) {
+            free(slots[i].thermo->alias);
+            free(slots[i].thermo);
+        }
+    }
+
+    free(slots);
+    slots = NULL;
+    count = 0;
+}
+
+/*
+ * Look up sensor by its ROM, registering it if not known yet. Sets
+ * `created` if the returned record is new and its state needs to be set up.
+ */
+thermometer_t *registry_get(const uint8_t *address, int *created)
+{
+    uint64_t rom = rom_key(address);
+    thermometer_t *thermo = NULL;
+
+    *created = 0;
+
+    pthread_mutex_lock(&lock);
+
+    registry_slot_t *slot = registry_find(rom);
+
+    if (slot->thermo != NULL) {
+        thermo = slot->thermo;
+
+        if (!thermo->known) {
+            /* Loaded from registry file, but never seen on a wire */
+            thermo->known = 1;
+            *created = 1;
+        }
+    } else {
+        thermo = registry_insert(rom, address, next_id, NULL);
+
+        if (thermo != NULL) {
+            thermo->known = 1;
+            *created = 1;
+
+            registry_append(thermo);
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return thermo;
+}
+
+int registry_count()
+{
+    return count;
+}
+
+int registry_alias_char(int c)
+{
+    return isalnum(c) || c == '_' || c == '-' || c == '.';
+}
+
+static uint64_t rom_key(const uint8_t *address)
+{
+    uint64_t rom = 0;
+
+    for (int i = 7; i >= 0; i--) {
+        rom = (rom << 8) | address[i];
+    }
+
+    return rom;
+}
+
+/* 64-bit finalizer of MurmurHash3, ROMs of one family differ in few bits */
+static uint32_t rom_hash(uint64_t rom)
+{
+    rom ^= rom >> 33;
+    rom *= 0xff51afd7ed558ccdULL;
+    rom ^= rom >> 33;
+    rom *= 0xc4ceb9fe1a85ec53ULL;
+    rom ^= rom >> 33;
+
+    return (uint32_t) rom;
+}
+
+/* Returns slot of the ROM, or the empty slot where it belongs */
+static registry_slot_t *registry_find(uint64_t rom)
+{
+    uint32_t i = rom_hash(rom) & slot_mask;
+
+    while (slots[i].rom != 0 && slots[i].rom != rom) {
+        i = (i + 1) & slot_mask;
+    }
+
+    return &slots[i];
+}
+
+static thermometer_t *registry_insert(uint64_t rom, const uint8_t *address, int id, const char *alias)
+{
+    if ((count + 1) * 2 > (int) slot_mask + 1 && registry_grow() != 0) {
+        return NULL;
+    }
+
+    thermometer_t *thermo = calloc(1, sizeof(thermometer_t));
+
+    if (thermo == NULL) {
+        return NULL;
+    }
+
+    memcpy(thermo->address, address, sizeof(thermo->address));
+    thermo->id = id;
+    thermo->status = TEMP_STATUS_FAIL;
+    thermo->wire_num = -1;
+
+    if (alias != NULL && alias[0] != 0) {
+        thermo->alias = malloc(strlen(alias) + 1);
+
+        if (thermo->alias != NULL) {
+            strcpy(thermo->alias, alias);
+        }
+    }
+
+    registry_slot_t *slot = registry_find(rom);
+
+    slot->rom = rom;
+    slot->thermo = thermo;
+    count++;
+
+    if (id >= next_id) {
+        next_id = id + 1;
+    }
+
+    return thermo;
+}
+
+static int registry_grow()
+{
+    uint32_t old_mask = slot_mask;
+    registry_slot_t *old_slots = slots;
+
+    slots = calloc((old_mask + 1) * 2, sizeof(registry_slot_t));
+
+    if (slots == NULL) {
+        slots = old_slots;
+        return -1;
+    }
+
+    slot_mask = (old_mask << 1) | 1;
+
+    for (uint32_t i = 0; i <= old_mask; i++) {
+        if (old_slots[i].rom != 0) {
+            *registry_find(old_slots[i].rom) = old_slots[i];
+        }
+    }
+
+    free(old_slots);
+
+    return 0;
+}
+
+static int registry_load()
+{
+    char line[REGISTRY_LINE_SIZE];
+    FILE *f = fopen(file_name, "r");
+
+    if (f == NULL) {
+        /* No registry yet, it will be created with the first sensor */
+        return 0;
+    }
+
+    int line_num = 0;
+
+    while (fgets(line, REGISTRY_LINE_SIZE, f) != NULL) {
+        line_num++;
+
+        uint8_t address[8];
+        unsigned int b[8];
+        int id;
+        char alias[REGISTRY_LINE_SIZE] = "";
+
+        int fields = sscanf(line, "%2x%2x%2x%2x%2x%2x%2x%2x\t%d\t%255[^\n]",
+            &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7], &id, alias);
+
+        if (fields < 9) {
+            continue;
+        }
+
+        registry_alias_clean(alias, line_num);
+
+        for (int i = 0; i < 8; i++) {
+            address[i] = b[i];
+        }
+
+        uint64_t rom = rom_key(address);
+
+        if (rom == 0 || registry_find(rom)->thermo != NULL) {
+            continue;
+        }
+
+        /* Two sensors with one id would be one sensor to whoever reads the outputs */
+        thermometer_t *other = (id > 0) ? registry_find_id(id) : NULL;
+
+        if (id <= 0 || other != NULL) {
+            const uint8_t *a = (other != NULL) ? other->address : address;
+
+            fprintf(stderr, "Sensor registry line %d: id %d is %s, sensor %02X%02X%02X%02X%02X%02X%02X%02X has it, "
+                "give every sensor an id of its own\n", line_num, id, (other != NULL) ? "used already" : "not valid",
+                a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+            fclose(f);
+            return -1;
+        }
+
+        if (registry_insert(rom, address, id, alias) == NULL) {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+/*
+ * Aliases go unquoted into all outputs. Other characters, like tabs or
+ * a trailing CR, are replaced by '_' and too long aliases are cut short.
+ */
+static void registry_alias_clean(char *alias, int line_num)
+{
+    int changed = 0;
+
+    if (strlen(alias) >= REGISTRY_ALIAS_SIZE) {
+        alias[REGISTRY_ALIAS_SIZE - 1] = '\0';
+        changed = 1;
+    }
+
+    for (char *c = alias; *c != '\0'; c++) {
+        if (!registry_alias_char((unsigned char) *c)) {
+            *c = '_';
+            changed = 1;
+        }
+    }
+
+    if (changed) {
+        fprintf(stderr, "Sensor registry line %d: alias changed to %s, only letters, digits, '_', '-' and '.' "
+            "up to %d characters are allowed\n", line_num, alias, REGISTRY_ALIAS_SIZE - 1);
+    }
+}
+
+/* Queues the new sensor for registry_flush(), wire threads do not wait for the disk; under the lock */
+static void registry_append(thermometer_t *thermo)
+{
+    if (file_name == NULL) {
+        return;
+    }
+
+    if (unsaved_count >= unsaved_max) {
+        thermometer_t **u = realloc(unsaved, (unsaved_max + REGISTRY_UNSAVED_STEP) * sizeof(thermometer_t *));
+
+        if (u == NULL) {
+            return;
+        }
+
+        unsaved = u;
+        unsaved_max += REGISTRY_UNSAVED_STEP;
+    }
+
+    unsaved[unsaved_count++] = thermo;
+}
+
+void registry_flush()
+{
+    pthread_mutex_lock(&lock);
+
+    thermometer_t **list = unsaved;
+    int list_count = unsaved_count;
+
+    unsaved = NULL;
+    unsaved_count = 0;
+    unsaved_max = 0;
+
+    pthread_mutex_unlock(&lock);
+
+    if (list_count == 0) {
+        free(list);
+        return;
+    }
+
+    FILE *f = fopen(file_name, "a");
+
+    if (f == NULL) {
+        perror("Error opening sensor registry");
+        free(list);
+        return;
+    }
+
+    /* Records are never freed before registry_release(), nor their ROM and id changed */
+    for (int i = 0; i < list_count; i++) {
+        const uint8_t *addr = list[i]->address;
+
+        fprintf(f, "%02X%02X%02X%02X%02X%02X%02X%02X\t%d\t\n",
+            addr[0], addr[1], addr[2], addr[3],
+            addr[4], addr[5], addr[6], addr[7],
+            list[i]->id
+        );
+    }
+
+    fclose(f);
+    free(list);
+}
+
+static thermometer_t *registry_find_id(int id)
+{
+    for (uint32_t i = 0; i <= slot_mask; i++) {
+        if (slots[i].thermo != NULL && slots[i].thermo->id == id) {
+            return slots[i].thermo;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef __TEMP_REGISTRY_H__
+#define __TEMP_REGISTRY_H__
+
+#include <stdint.h>
+
+#include "temp_types.h"
+
+/*
+ * Registry of all sensors ever seen, keyed by 64-bit ROM. It owns the state
+ * of every sensor, which therefore survives re-searches and moves between
+ * wires, and gives every sensor a stable id and an optional alias. With a
+ * registry file ids and aliases survive restarts as well; the file is a TSV
+ * of ROM, id and alias, new sensors are appended to it and aliases may be
+ * edited by hand. A file giving one id to two sensors is refused.
+ */
+#define REGISTRY_ALIAS_SIZE 64 // Longest alias + 1
+
+int registry_init(const char *file_name);
+
+void registry_release();
+
+thermometer_t *registry_get(const uint8_t *address, int *created);
+
+/* Appends sensors found since the last call to the file; by the main thread, so wire threads never wait for it */
+void registry_flush();
+
+int registry_count();
+
+/* Characters aliases may have, so they need no quoting in TSV, JSON nor topics */
+int registry_alias_char(int c);
+
+#endif /* __TEMP_REGISTRY_H__ */
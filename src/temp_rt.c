@@ -0,0 +1,178 @@
+#define _GNU_SOURCE // CPU affinity and default thread attributes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "temp_rt.h"
+
+#define RT_STACK_SIZE (512 * 1024) // Thread stacks are locked in full, keep them modest
+
+static int rt_policy = -1;
+static int rt_priority = 0;
+static int rt_lock = 0;
+static int rt_verbose = 0;
+
+static int cpus[RT_CPUS_MAX];
+static int cpu_count = 0;
+
+void rt_config(int policy, int priority, int lock_memory, int verbose)
+{
+    rt_policy = policy;
+    rt_priority = priority;
+    rt_lock = lock_memory;
+    rt_verbose = verbose;
+}
+
+int rt_parse_cpus(const char *list)
+{
+    const char *p = list;
+
+    cpu_count = 0;
+
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p || first < 0) {
+            return -1;
+        }
+
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (cpu_count == RT_CPUS_MAX || cpu >= CPU_SETSIZE) {
+                return -1;
+            }
+
+            cpus[cpu_count++] = cpu;
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+
+        p = end;
+    }
+
+    return cpu_count > 0 ? 0 : -1;
+}
+
+const char *rt_policy_name(int policy)
+{
+    switch (policy) {
+        case SCHED_FIFO:
+            return "SCHED_FIFO";
+        case SCHED_RR:
+            return "SCHED_RR";
+        case SCHED_OTHER:
+            return "SCHED_OTHER";
+        default:
+            return "unknown";
+    }
+}
+
+int rt_lock_memory()
+{
+    if (!rt_lock) {
+        return 0;
+    }
+
+    /* Locked future mappings include every thread stack, 8 MiB by default */
+    pthread_attr_t attr;
+
+    if (pthread_attr_init(&attr) == 0) {
+        pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+        pthread_setattr_default_np(&attr);
+        pthread_attr_destroy(&attr);
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "Could not lock memory: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (rt_verbose) {
+        printf("Memory locked, thread stacks %d KiB\n", RT_STACK_SIZE / 1024);
+    }
+
+    return 0;
+}
+
+/* Touch the stack the thread is going to use, so no page faults happen during a transaction */
+static void __attribute__((noinline)) prefault_stack()
+{
+    volatile char stack[RT_STACK_PREFAULT];
+
+    memset((char *) stack, 0, sizeof(stack));
+}
+
+void rt_thread_setup(const char *device, int wire_num)
+{
+    pthread_t self = pthread_self();
+    int rc;
+
+    if (rt_policy >= 0) {
+        struct sched_param param = { .sched_priority = rt_priority };
+
+        rc = pthread_setschedparam(self, rt_policy, &param);
+
+        if (rc != 0) {
+            fprintf(stderr, "Could not set %s priority %d for %s: %s\n",
+                rt_policy_name(rt_policy), rt_priority, device, strerror(rc));
+        }
+    }
+
+    if (cpu_count > 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpus[wire_num % cpu_count], &set);
+
+        rc = pthread_setaffinity_np(self, sizeof(set), &set);
+
+        if (rc != 0) {
+            fprintf(stderr, "Could not pin %s to CPU %d: %s\n", device, cpus[wire_num % cpu_count], strerror(rc));
+        }
+    }
+
+    if (rt_policy >= 0 || rt_lock) {
+        prefault_stack();
+    }
+
+    if (rt_verbose) {
+        /* Report what the kernel actually granted */
+        struct sched_param param;
+        int policy = -1;
+        cpu_set_t set;
+
+        pthread_getschedparam(self, &policy, &param);
+        printf("Thread for %s: %s priority %d", device, rt_policy_name(policy), param.sched_priority);
+
+        if (pthread_getaffinity_np(self, sizeof(set), &set) == 0) {
+            printf(", CPUs");
+
+            for (int cpu = 0, n = 0; cpu < CPU_SETSIZE && n < CPU_COUNT(&set); cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    printf("%s%d", n++ ? "," : " ", cpu);
+                }
+            }
+        }
+
+        printf("\n");
+    }
+}
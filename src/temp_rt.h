@@ -0,0 +1,30 @@
+#ifndef __TEMP_RT_H__
+#define __TEMP_RT_H__
+
+#define RT_CPUS_MAX 64
+#define RT_STACK_PREFAULT (64 * 1024) // Bytes of wire thread stack touched up front
+
+/*
+ * Real-time treatment of wire threads. Bit timing of USART adapters is done
+ * by the kernel, but every byte of a search or scratchpad read is a round
+ * trip through the wire thread, so a thread preempted by other processes
+ * stretches transactions and makes adapters time out. Each setting is best
+ * effort: what was not granted (usually for lack of CAP_SYS_NICE or
+ * RLIMIT_MEMLOCK) is reported and the daemon runs on without it.
+ */
+
+/* Policy is SCHED_FIFO or SCHED_RR, -1 to keep the default */
+void rt_config(int policy, int priority, int lock_memory, int verbose);
+
+/* Comma separated CPUs and ranges, e.g. "2,3" or "1-3". Wires are pinned round-robin. */
+int rt_parse_cpus(const char *list);
+
+/* Lock all current and future pages of the process, before threads start */
+int rt_lock_memory();
+
+/* Called by every wire thread before its first cycle */
+void rt_thread_setup(const char *device, int wire_num);
+
+const char *rt_policy_name(int policy);
+
+#endif /* __TEMP_RT_H__ */
@@ -0,0 +1,84 @@
+#include <math.h>
+
+#include "temp_types.h"
+#include "temp_schedule.h"
+
+static int adaptive = 0;
+static long interval_start = 60;
+static long interval_min = 10;
+static long interval_max = 600;
+static float change_delta = 0.25;
+
+void schedule_config(int s_adaptive, long interval, long min, long max, float delta)
+{
+    adaptive = s_adaptive;
+    interval_min = (min > 0) ? min : 1;
+    interval_max = (max > interval_min) ? max : interval_min;
+    change_delta = (delta > 0) ? delta : 0.25;
+
+    interval_start = interval;
+
+    if (interval_start < interval_min) {
+        interval_start = interval_min;
+    } else if (interval_start > interval_max) {
+        interval_start = interval_max;
+    }
+}
+
+void schedule_init(thermometer_t *thermo, long now)
+{
+    thermo->interval = interval_start;
+    thermo->last_read = 0;
+    thermo->next_read = now; // Read a new sensor on the first cycle
+    thermo->last_temperature = 0;
+}
+
+int schedule_due(thermometer_t *thermo, long now)
+{
+    if (!adaptive) {
+        return 1;
+    }
+
+    return now >= thermo->next_read;
+}
+
+/*
+ * Called after a successful read. The interval aims for a change of about
+ * `change_delta` degrees between two reads: it is derived from the observed
+ * rate of change, but grows no faster than twice per read, so a single quiet
+ * reading does not push a sensor straight to the maximum interval.
+ */
+void schedule_update(thermometer_t *thermo, long now)
+{
+    if (!adaptive) {
+        return;
+    }
+
+    if (thermo->last_read > 0 && now > thermo->last_read) {
+        float change = fabsf(thermo->temperature - thermo->last_temperature);
+        long target;
+
+        if (change > 0) {
+            float rate = change / (float) (now - thermo->last_read);
+            target = (long) (change_delta / rate);
+        } else {
+            target = interval_max;
+        }
+
+        if (target > thermo->interval * 2) {
+            target = thermo->interval * 2;
+        }
+
+        if (target < interval_min) {
+            target = interval_min;
+        } else if (target > interval_max) {
+            target = interval_max;
+        }
+
+        thermo->interval = target;
+    }
+
+    thermo->last_read = now;
+    thermo->last_temperature = thermo->temperature;
+    thermo->next_read = now + thermo->interval;
+}
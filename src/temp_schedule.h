@@ -0,0 +1,20 @@
+#ifndef __TEMP_SCHEDULE_H__
+#define __TEMP_SCHEDULE_H__
+
+#include "temp_types.h"
+
+/*
+ * Per-sensor read scheduling. In adaptive mode every sensor has its own read
+ * interval, which is shortened while the temperature moves and lengthened
+ * while it stays stable, bounded by min and max. Otherwise every sensor is
+ * due on every cycle.
+ */
+void schedule_config(int adaptive, long interval, long min, long max, float delta);
+
+void schedule_init(thermometer_t *thermo, long now);
+
+int schedule_due(thermometer_t *thermo, long now);
+
+void schedule_update(thermometer_t *thermo, long now);
+
+#endif /* __TEMP_SCHEDULE_H__ */
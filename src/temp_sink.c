@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_time.h"
+
+#define SINK_COUNT_STEP 4
+#define SINK_SPEC_SIZE 256
+#define SINK_NAME_SIZE 32
+#define SINK_OVERRIDES_MAX 16
+
+typedef struct sink {
+    const temp_sink_api_t *api;
+    void *ctx;
+    void *dl;
+
+    int policy;
+    int queue_max;
+    int queue_head;
+    int queue_count;
+    temp_snapshot_t **queue;
+
+    pthread_t tid;
+    int running;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    unsigned long written;
+    unsigned long failed;
+    unsigned long dropped;
+
+    /* Age of readings when written out, since the last report */
+    unsigned long age_count;
+    uint64_t age_sum;
+    uint64_t age_max;
+} sink_t;
+
+/* Queue size and policy given for sinks of one name, -1 where the default applies */
+typedef struct sink_override {
+    char name[SINK_NAME_SIZE];
+    int queue_size;
+    int policy;
+} sink_override_t;
+
+static sink_override_t overrides[SINK_OVERRIDES_MAX];
+static int overrides_count = 0;
+
+/* Each sink is allocated on its own, its mutex and conditions must not move */
+static sink_t **sinks = NULL;
+static int sinks_count = 0;
+static int sinks_max = 0;
+
+static void *sink_thread(void *);
+static void sink_release(sink_t *sink);
+
+/*
+ * Set queue size or policy of sinks named `name` (first `name_len` characters),
+ * overriding the values sink_add() is given. -1 leaves the value as it is.
+ */
+int sink_override(const char *name, size_t name_len, int queue_size, int policy)
+{
+    if (name_len == 0 || name_len >= SINK_NAME_SIZE) {
+        return -1;
+    }
+
+    sink_override_t *o = NULL;
+
+    for (int i = 0; i < overrides_count; i++) {
+        if (strncmp(overrides[i].name, name, name_len) == 0 && overrides[i].name[name_len] == '\0') {
+            o = &overrides[i];
+            break;
+        }
+    }
+
+    if (o == NULL) {
+        if (overrides_count >= SINK_OVERRIDES_MAX) {
+            return -2;
+        }
+
+        o = &overrides[overrides_count++];
+        memcpy(o->name, name, name_len);
+        o->name[name_len] = '\0';
+        o->queue_size = -1;
+        o->policy = -1;
+    }
+
+    if (queue_size >= 0) {
+        o->queue_size = queue_size;
+    }
+
+    if (policy >= 0) {
+        o->policy = policy;
+    }
+
+    return 0;
+}
+
+int sink_add(const temp_sink_api_t *api, const char *args, int queue_size, int policy)
+{
+    if (api->api_version != TEMP_SINK_API_VERSION) {
+        fprintf(stderr, "Sink %s has API version %d, expected %d\n",
+            api->name, api->api_version, TEMP_SINK_API_VERSION);
+        return -1;
+    }
+
+    if (api->snapshot_size != sizeof(temp_snapshot_t) || api->reading_size != sizeof(temp_reading_t)) {
+        fprintf(stderr, "Sink %s was built with another snapshot layout, rebuild it\n", api->name);
+        return -1;
+    }
+
+    if (sinks_count >= sinks_max) {
+        sink_t **s = realloc(sinks, (sinks_max + SINK_COUNT_STEP) * sizeof(sink_t *));
+
+        if (s == NULL) {
+            return -2;
+        }
+
+        sinks = s;
+        sinks_max += SINK_COUNT_STEP;
+    }
+
+    sink_t *sink = calloc(1, sizeof(sink_t));
+
+    if (sink == NULL) {
+        return -2;
+    }
+
+    for (int i = 0; i < overrides_count; i++) {
+        if (strcmp(overrides[i].name, api->name) == 0) {
+            if (overrides[i].queue_size >= 0) {
+                queue_size = overrides[i].queue_size;
+            }
+
+            if (overrides[i].policy >= 0) {
+                policy = overrides[i].policy;
+            }
+        }
+    }
+
+    sink->api = api;
+    sink->policy = policy;
+    sink->queue_max = (queue_size > 0) ? queue_size : 1;
+    sink->queue = calloc(sink->queue_max, sizeof(temp_snapshot_t *));
+
+    if (sink->queue == NULL) {
+        free(sink);
+        return -2;
+    }
+
+    sink->ctx = api->open(args);
+
+    if (sink->ctx == NULL) {
+        fprintf(stderr, "Could not open sink %s\n", api->name);
+        free(sink->queue);
+        free(sink);
+        return -3;
+    }
+
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->not_empty, NULL);
+    pthread_cond_init(&sink->not_full, NULL);
+
+    sinks[sinks_count++] = sink;
+
+    return 0;
+}
+
+/*
+ * Load external sink from shared object, `spec` is `<file.so>[:<args>]`.
+ */
+int sink_load(const char *spec, int queue_size, int policy)
+{
+    char path[SINK_SPEC_SIZE];
+    const char *args = strchr(spec, ':');
+
+    if (args != NULL) {
+        snprintf(path, SINK_SPEC_SIZE, "%.*s", (int) (args - spec), spec);
+        args++;
+    } else {
+        snprintf(path, SINK_SPEC_SIZE, "%s", spec);
+        args = "";
+    }
+
+    void *dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if (dl == NULL) {
+        fprintf(stderr, "Could not load sink: %s\n", dlerror());
+        return -1;
+    }
+
+    const temp_sink_api_t *api = dlsym(dl, TEMP_SINK_SYMBOL);
+
+    if (api == NULL) {
+        fprintf(stderr, "No %s symbol in sink %s\n", TEMP_SINK_SYMBOL, path);
+        dlclose(dl);
+        return -1;
+    }
+
+    int status = sink_add(api, args, queue_size, policy);
+
+    if (status != 0) {
+        dlclose(dl);
+        return status;
+    }
+
+    sinks[sinks_count - 1]->dl = dl;
+
+    return 0;
+}
+
+int sink_count()
+{
+    return sinks_count;
+}
+
+/*
+ * Snapshot buffers needed for acquisition to never run out: one being
+ * written plus, for every sink, a full queue and one being written out.
+ */
+int sink_buffers_needed()
+{
+    int buffers = 1;
+
+    for (int i = 0; i < sinks_count; i++) {
+        buffers += sinks[i]->queue_max + 1;
+    }
+
+    return buffers;
+}
+
+int sink_start_all()
+{
+    for (int i = 0; i < sinks_count; i++) {
+        if (pthread_create(&sinks[i]->tid, NULL, sink_thread, sinks[i]) != 0) {
+            fprintf(stderr, "Could not start thread of sink %s\n", sinks[i]->api->name);
+            return -1;
+        }
+
+        sinks[i]->running = 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Queue the snapshot to every sink. Each queued entry holds its own
+ * reference, the caller keeps (and releases) its own.
+ */
+void sink_publish(temp_snapshot_t *snap)
+{
+    for (int i = 0; i < sinks_count; i++) {
+        sink_t *sink = sinks[i];
+
+        pthread_mutex_lock(&sink->lock);
+
+        if (sink->queue_count >= sink->queue_max) {
+            if (sink->policy == SINK_POLICY_BLOCK) {
+                while (sink->queue_count >= sink->queue_max && !sink->stopping) {
+                    pthread_cond_wait(&sink->not_full, &sink->lock);
+                }
+            } else {
+                snapshot_release(sink->queue[sink->queue_head]);
+                sink->queue_head = (sink->queue_head + 1) % sink->queue_max;
+                sink->queue_count--;
+                sink->dropped++;
+            }
+        }
+
+        if (sink->queue_count < sink->queue_max) {
+            snapshot_retain(snap);
+            sink->queue[(sink->queue_head + sink->queue_count) % sink->queue_max] = snap;
+            sink->queue_count++;
+
+            pthread_cond_signal(&sink->not_empty);
+        }
+
+        pthread_mutex_unlock(&sink->lock);
+    }
+}
+
+/*
+ * Print counters and the age of readings (from the read to written out by
+ * the sink) of every sink. Age statistics start over after each report.
+ */
+void sink_report()
+{
+    for (int i = 0; i < sinks_count; i++) {
+        sink_t *sink = sinks[i];
+
+        pthread_mutex_lock(&sink->lock);
+
+        printf("Sink %s: %lu written, %lu failed, %lu dropped", sink->api->name,
+            sink->written, sink->failed, sink->dropped);
+
+        if (sink->age_count > 0) {
+            printf(", reading age avg %.1f ms, max %.1f ms",
+                (double) sink->age_sum / sink->age_count / NS_PER_MS, (double) sink->age_max / NS_PER_MS);
+        }
+
+        printf("\n");
+
+        sink->age_count = 0;
+        sink->age_sum = 0;
+        sink->age_max = 0;
+
+        pthread_mutex_unlock(&sink->lock);
+    }
+}
+
+/*
+ * Stop all sinks: already queued snapshots are still written out.
+ */
+void sink_stop_all(int verbose)
+{
+    for (int i = 0; i < sinks_count; i++) {
+        sink_t *sink = sinks[i];
+
+        if (sink->running) {
+            pthread_mutex_lock(&sink->lock);
+            sink->stopping = 1;
+            pthread_cond_broadcast(&sink->not_empty);
+            pthread_cond_broadcast(&sink->not_full);
+            pthread_mutex_unlock(&sink->lock);
+
+            pthread_join(sink->tid, NULL);
+        }
+
+    }
+
+    if (verbose) {
+        sink_report();
+    }
+
+    for (int i = 0; i < sinks_count; i++) {
+        sink_release(sinks[i]);
+        free(sinks[i]);
+    }
+
+    free(sinks);
+    sinks = NULL;
+    sinks_count = 0;
+    sinks_max = 0;
+}
+
+static void *sink_thread(void *sink_v)
+{
+    sink_t *sink = (sink_t *) sink_v;
+
+    while (1) {
+        pthread_mutex_lock(&sink->lock);
+
+        while (sink->queue_count == 0 && !sink->stopping) {
+            pthread_cond_wait(&sink->not_empty, &sink->lock);
+        }
+
+        if (sink->queue_count == 0) {
+            pthread_mutex_unlock(&sink->lock);
+            break;
+        }
+
+        temp_snapshot_t *snap = sink->queue[sink->queue_head];
+        sink->queue_head = (sink->queue_head + 1) % sink->queue_max;
+        sink->queue_count--;
+
+        pthread_cond_signal(&sink->not_full);
+        pthread_mutex_unlock(&sink->lock);
+
+        int status = sink->api->write_snapshot(sink->ctx, snap);
+        uint64_t now = time_mono_ns();
+        unsigned long age_count = 0;
+        uint64_t age_sum = 0;
+        uint64_t age_max = 0;
+
+        /* Readings of this cycle only, sensors not due keep their older ones */
+        for (int t = 0; t < snap->thermo_count && status == 0; t++) {
+            const temp_reading_t *thermo = &snap->readings[t];
+
+            if (thermo->ts_read >= snap->ts_cycle && thermo->ts_read <= now) {
+                uint64_t age = now - thermo->ts_read;
+
+                age_sum += age;
+                age_max = (age > age_max) ? age : age_max;
+                age_count++;
+            }
+        }
+
+        snapshot_release(snap);
+
+        pthread_mutex_lock(&sink->lock);
+
+        if (status == 0) {
+            sink->written++;
+            sink->age_count += age_count;
+            sink->age_sum += age_sum;
+            sink->age_max = (age_max > sink->age_max) ? age_max : sink->age_max;
+        } else {
+            sink->failed++;
+        }
+
+        int idle = (sink->queue_count == 0);
+        pthread_mutex_unlock(&sink->lock);
+
+        if (idle && sink->api->flush != NULL) {
+            sink->api->flush(sink->ctx);
+        }
+    }
+
+    return NULL;
+}
+
+static void sink_release(sink_t *sink)
+{
+    while (sink->queue_count > 0) {
+        snapshot_release(sink->queue[sink->queue_head]);
+        sink->queue_head = (sink->queue_head + 1) % sink->queue_max;
+        sink->queue_count--;
+    }
+
+    sink->api->close(sink->ctx);
+
+    if (sink->dl != NULL) {
+        dlclose(sink->dl);
+    }
+
+    free(sink->queue);
+
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->not_empty);
+    pthread_cond_destroy(&sink->not_full);
+}
@@ -0,0 +1,74 @@
+#ifndef __TEMP_SINK_H__
+#define __TEMP_SINK_H__
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+
+/*
+ * Output sink interface. Built-in outputs (TSV, JSON, MQTT) implement it,
+ * and external sinks can be loaded from shared objects, which must export
+ * a `temp_sink_api_t` variable named TEMP_SINK_SYMBOL:
+ *
+ *   const temp_sink_api_t temp_sink = {
+ *       TEMP_SINK_ABI, "csv", csv_open, csv_write, csv_flush, csv_close
+ *   };
+ *
+ * Sinks see sensors only as temp_reading_t records of the snapshot, never
+ * the internal thermometer_t. The version is bumped in the same change that
+ * alters this structure, the snapshot or the reading record; sinks built
+ * against another version are refused. TEMP_SINK_ABI also records the sizes
+ * of the snapshot and the reading record the sink was built with, so a
+ * layout change that misses the bump is still refused rather than loaded.
+ *
+ * Versions:
+ *   1 - initial interface
+ *   2 - monotonic and wall clock stamps in the snapshot
+ *   3 - wall clock time of the cycle in the snapshot
+ *   4 - alert, query and integrity state of thermometer_t
+ *   5 - temp_reading_t instead of thermometer_t
+ *   6 - record sizes checked on load
+ *
+ * Every sink runs on its own thread with its own bounded queue of snapshots,
+ * so a slow sink does not hold back the others nor the acquisition.
+ * write_snapshot() must not keep the snapshot after returning. flush() is
+ * called when the queue runs empty and may be NULL.
+ */
+#define TEMP_SINK_API_VERSION 6
+#define TEMP_SINK_SYMBOL "temp_sink"
+
+#define TEMP_SINK_ABI TEMP_SINK_API_VERSION, sizeof(temp_snapshot_t), sizeof(temp_reading_t)
+
+typedef struct temp_sink_api {
+    int api_version;
+    size_t snapshot_size;
+    size_t reading_size;
+    const char *name;
+
+    void *(*open)(const char *args);
+    int (*write_snapshot)(void *ctx, const temp_snapshot_t *snap);
+    int (*flush)(void *ctx);
+    void (*close)(void *ctx);
+} temp_sink_api_t;
+
+#define SINK_POLICY_DROP 0 // Drop the oldest queued snapshot when queue is full
+#define SINK_POLICY_BLOCK 1 // Make acquisition wait for a free queue slot
+
+int sink_override(const char *name, size_t name_len, int queue_size, int policy);
+
+int sink_add(const temp_sink_api_t *api, const char *args, int queue_size, int policy);
+
+int sink_load(const char *spec, int queue_size, int policy);
+
+int sink_count();
+
+int sink_buffers_needed();
+
+int sink_start_all();
+
+void sink_publish(temp_snapshot_t *snap);
+
+void sink_report();
+
+void sink_stop_all(int verbose);
+
+#endif /* __TEMP_SINK_H__ */
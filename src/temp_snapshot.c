@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+
+/*
+ * A pool of reference counted snapshot buffers. Acquisition writes into a
+ * buffer nobody holds and hands it over to sinks, each queued snapshot holds
+ * a reference. The pool is sized by sinks (see sink_buffers_needed()), so the
+ * writer always finds a free buffer and never waits for outputs.
+ */
+static temp_snapshot_t *pool = NULL;
+static int pool_size = 0;
+
+static unsigned long seq = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int snapshot_reserve(temp_snapshot_t *snap, int wire_count, int thermo_count);
+static void reading_copy(temp_reading_t *reading, const thermometer_t *thermo);
+
+int snapshot_pool_init(int size)
+{
+    pool = calloc(size, sizeof(temp_snapshot_t));
+
+    if (pool == NULL) {
+        return -1;
+    }
+
+    pool_size = size;
+
+    return 0;
+}
+
+void snapshot_pool_release()
+{
+    for (int i = 0; i < pool_size; i++) {
+        free(pool[i].wires);
+        free(pool[i].readings);
+    }
+
+    free(pool);
+    pool = NULL;
+    pool_size = 0;
+}
+
+/*
+ * Copy the current state of wires into a free buffer. Called by the
+ * acquisition after all wire threads are joined, thus the wires are not
+ * modified while copying. Returned snapshot holds one reference of the
+ * caller, NULL if no buffer is free.
+ */
+temp_snapshot_t *snapshot_take(wire_t *wires, int wire_count, long uptime)
+{
+    temp_snapshot_t *snap = NULL;
+    int thermo_count = 0;
+
+    for (int i = 0; i < wire_count; i++) {
+        thermo_count += wires[i].thermo_count;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    for (int i = 0; i < pool_size; i++) {
+        if (pool[i].refs == 0) {
+            snap = &pool[i];
+            snap->refs = 1;
+            snap->seq = ++seq;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (snap == NULL) {
+        return NULL;
+    }
+
+    if (snapshot_reserve(snap, wire_count, thermo_count) != 0) {
+        snapshot_release(snap);
+        return NULL;
+    }
+
+    snap->uptime = uptime;
+    snap->window = 0;
+    snap->wire_count = wire_count;
+
+    int t = 0;
+
+    for (int i = 0; i < wire_count; i++) {
+        int first = t;
+
+        snap->wires[i].device = wires[i].device;
+        snap->wires[i].status = wires[i].status;
+
+        for (int j = 0; j < wires[i].thermo_count; j++) {
+            /* Sensor moved to another wire is reported there only */
+            if (wires[i].thermometers[j]->wire_num == wires[i].num) {
+                reading_copy(&snap->readings[t++], wires[i].thermometers[j]);
+            }
+        }
+
+        snap->wires[i].thermo_count = t - first;
+    }
+
+    snap->thermo_count = t;
+
+    return snap;
+}
+
+void snapshot_retain(temp_snapshot_t *snap)
+{
+    pthread_mutex_lock(&lock);
+    snap->refs++;
+    pthread_mutex_unlock(&lock);
+}
+
+void snapshot_release(temp_snapshot_t *snap)
+{
+    pthread_mutex_lock(&lock);
+    snap->refs--;
+    pthread_mutex_unlock(&lock);
+}
+
+static int snapshot_reserve(temp_snapshot_t *snap, int wire_count, int thermo_count)
+{
+    if (wire_count > snap->wire_max) {
+        snap_wire_t *w = realloc(snap->wires, wire_count * sizeof(snap_wire_t));
+
+        if (w == NULL) {
+            return -1;
+        }
+
+        snap->wires = w;
+        snap->wire_max = wire_count;
+    }
+
+    if (thermo_count > snap->thermo_max) {
+        int max = thermo_count + THERMO_COUNT_STEP;
+        temp_reading_t *r = realloc(snap->readings, max * sizeof(temp_reading_t));
+
+        if (r == NULL) {
+            return -1;
+        }
+
+        snap->readings = r;
+        snap->thermo_max = max;
+    }
+
+    return 0;
+}
+
+/* Only what outputs need, the internal state of the sensor stays behind */
+static void reading_copy(temp_reading_t *reading, const thermometer_t *thermo)
+{
+    memcpy(reading->address, thermo->address, sizeof(reading->address));
+    reading->id = thermo->id;
+    reading->alias = thermo->alias;
+    reading->family = thermo->family->name;
+    memcpy(reading->scratchpad, thermo->scratchpad, sizeof(reading->scratchpad));
+    reading->temperature = thermo->temperature;
+    reading->status = thermo->status;
+    reading->wire_num = thermo->wire_num;
+
+    reading->ts_convert = thermo->ts_convert;
+    reading->ts_read = thermo->ts_read;
+    reading->ts_wall = thermo->ts_wall;
+
+    reading->crc_errors = thermo->crc_errors;
+    reading->read_errors = thermo->read_errors;
+    reading->fail_streak = thermo->fail_streak;
+    reading->last_good = thermo->last_good;
+    reading->quarantine_until = thermo->quarantine_until;
+    reading->spikes = thermo->spikes;
+
+    reading->win_min = thermo->win_min;
+    reading->win_max = thermo->win_max;
+    reading->win_mean = thermo->win_mean;
+    reading->win_last = thermo->win_last;
+    reading->win_count = thermo->win_count;
+}
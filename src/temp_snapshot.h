@@ -0,0 +1,82 @@
+#ifndef __TEMP_SNAPSHOT_H__
+#define __TEMP_SNAPSHOT_H__
+
+#include "temp_types.h"
+
+/*
+ * Reading of one sensor as outputs see it. Unlike thermometer_t, which
+ * keeps the internal state of filters, scheduling, health and so on, this
+ * record is part of the sink API (see temp_sink.h): it changes only along
+ * with TEMP_SINK_API_VERSION, so external sinks survive internal changes.
+ */
+typedef struct temp_reading {
+    uint8_t address[8];
+    int id; // Stable id, see temp_registry.h
+    const char *alias; // NULL if none
+    const char *family; // Name of the ROM family
+    uint8_t scratchpad[__SCR_LENGTH];
+    float temperature;
+    int status;
+    int wire_num;
+
+    /* Timestamps, ns */
+    uint64_t ts_convert; // Monotonic, the last conversion started
+    uint64_t ts_read; // Monotonic, the last successful read
+    uint64_t ts_wall; // Wall clock of the last successful read, since the Epoch
+
+    /* Health */
+    unsigned long crc_errors;
+    unsigned long read_errors;
+    int fail_streak;
+    long last_good;
+    long quarantine_until;
+    unsigned long spikes; // Readings rejected by the filter
+
+    /* Window aggregates, valid if win_count > 0 */
+    float win_min;
+    float win_max;
+    float win_mean;
+    float win_last;
+    int win_count;
+} temp_reading_t;
+
+typedef struct snap_wire {
+    char *device;
+    int status;
+    int thermo_count;
+} snap_wire_t;
+
+/*
+ * Immutable copy of all wires and sensors, taken after each acquisition
+ * cycle. Readings of all wires are kept in a single array, in the order
+ * of wires, so their index is the sensor number in outputs.
+ */
+typedef struct temp_snapshot {
+    unsigned long seq;
+    long uptime;
+    long window; // Length of aggregates window, 0 if not aggregating
+    uint64_t ts_cycle; // Monotonic start of the read cycle, ns
+    uint64_t ts_wall; // Wall clock of the same, ns since the Epoch
+
+    int wire_count;
+    int wire_max;
+    snap_wire_t *wires;
+
+    int thermo_count;
+    int thermo_max;
+    temp_reading_t *readings;
+
+    int refs;
+} temp_snapshot_t;
+
+int snapshot_pool_init(int size);
+
+void snapshot_pool_release();
+
+temp_snapshot_t *snapshot_take(wire_t *wires, int wire_count, long uptime);
+
+void snapshot_retain(temp_snapshot_t *snap);
+
+void snapshot_release(temp_snapshot_t *snap);
+
+#endif /* __TEMP_SNAPSHOT_H__ */
@@ -0,0 +1,31 @@
+#include <time.h>
+#include <errno.h>
+
+#include "temp_time.h"
+
+/* Monotonic time, ns. Not affected by wall clock changes. */
+uint64_t time_mono_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+/* Wall clock time, ns since the Epoch. For correlation with other systems. */
+uint64_t time_wall_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t) ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+void time_sleep_ns(uint64_t ns)
+{
+    struct timespec ts = { .tv_sec = ns / NS_PER_S, .tv_nsec = ns % NS_PER_S };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
@@ -0,0 +1,15 @@
+#ifndef __TEMP_TIME_H__
+#define __TEMP_TIME_H__
+
+#include <stdint.h>
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_S 1000000000ULL
+
+uint64_t time_mono_ns();
+
+uint64_t time_wall_ns();
+
+void time_sleep_ns(uint64_t ns);
+
+#endif /* __TEMP_TIME_H__ */
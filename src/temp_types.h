@@ -3,24 +3,83 @@
 
 #define WIRE_COUNT_STEP 5
 #define THERMO_COUNT_STEP 5
+#define FILTER_MAX 9 // Longest median window
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 
 #include "dallas.h"
+#include "temp_family.h"
 
 #define TEMP_STATUS_OK 1
 #define TEMP_STATUS_FAIL 0
 
 typedef struct thermometer {
     uint8_t address[8];
+    int id; // Stable id, see temp_registry.h
+    char *alias;
+    int known;
+    const temp_family_t *family;
     uint8_t scratchpad[__SCR_LENGTH];
     float temperature;
     int status;
+    atomic_int wire_num; // Wire reading the sensor, -1 if none yet; changed only between cycles
+
+    /* Timestamps, ns */
+    uint64_t ts_convert; // Monotonic, the last conversion started
+    uint64_t ts_read; // Monotonic, the last successful read
+    uint64_t ts_wall; // Wall clock of the last successful read, since the Epoch
+
+    /* Adaptive read scheduling, see temp_schedule.h */
+    long interval;
+    long last_read;
+    long next_read;
+    float last_temperature;
+
+    /* Health, see temp_health.h */
+    unsigned long crc_errors;
+    unsigned long read_errors;
+    int fail_streak;
+    long last_good;
+    long quarantine_until;
+
+    /* Filter, see temp_filter.h */
+    float filter_ring[FILTER_MAX];
+    float filter_sorted[FILTER_MAX];
+    int filter_count;
+    int filter_head;
+    int filter_rejects;
+    float filter_ema;
+    unsigned long spikes;
+
+    /* Window aggregates, see temp_aggregate.h */
+    float agg_min;
+    float agg_max;
+    double agg_sum;
+    float agg_last;
+    int agg_count;
+    float win_min;
+    float win_max;
+    float win_mean;
+    float win_last;
+    int win_count;
+
+    /* Alerts, see temp_alert.h */
+    const struct alert_rule *alert_rule;
+    int alert_state;
+    float alert_ref; // Reference reading for the rate of change
+    uint64_t alert_ref_ts;
+
+    /* Integrity checking, see temp_integrity.h */
+    float integrity_rate; // Recent rate of read and CRC errors
+    float integrity_last; // Last good value, NAN if none yet
+    unsigned long escalations; // Reads checked in full as the quick one was suspect or after errors
 } thermometer_t;
 
 
 typedef struct wire {
+    int num;
     char *device;
     owu_struct_t onewire;
     ow_driver_ptr driver;
@@ -29,10 +88,28 @@ typedef struct wire {
 
     pthread_t tid;
     int tret;
+    unsigned long cycle; // Last read cycle started by the worker
+    int busy; // Reading in the current cycle
+
+    /* Deadlines and load shedding, see temp_deadline.h */
+    uint64_t deadline;
+    unsigned long overruns; // Cycles the deadline was missed in
+    unsigned long stalls; // Cycles the worker had to be kicked out of the driver
+    unsigned long shed; // Sensor reads deferred to the next cycle
+    int shed_cycles; // Cycles left to shed load for
+    int shed_next; // Sensor to start reading from
+    int cycle_shed;
+    uint64_t read_ns; // Average time to read a sensor
+    unsigned long query_seen; // Last on-demand read request looked at, see temp_query.h
 
     int thermo_count;
     int thermo_max;
-    thermometer_t *thermometers;
+    thermometer_t **thermometers; // Owned by the sensor registry
+
+    /* Sensors found here but read by another wire, handed over between cycles */
+    int moved_count;
+    int moved_max;
+    thermometer_t **moved;
 } wire_t;
 
 #endif /* __TEMP_TYPES_H__ */
\ No newline at end of file
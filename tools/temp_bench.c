@@ -0,0 +1,633 @@
+/*
+ * Benchmark of the output paths: builds synthetic installations of many
+ * wires and sensors and has every output write snapshots of them, to files
+ * on tmpfs and to a stand-in MQTT broker on loopback. For every output and
+ * size it prints a tab separated line of time per cycle (min, median and
+ * 90th percentile, us), heap allocations and allocated bytes, write
+ * syscalls and bytes written per cycle:
+ *
+ *   temp_bench -w 1,10,100 -s 10,1000,10000 -o tsv,json,mqtt -n 50
+ *
+ * MQTT time is until the stand-in broker has got the whole snapshot, not
+ * just until it is queued. Allocations are counted across all threads and
+ * libraries, write syscalls and bytes from /proc/self/io, so the broker
+ * runs in a process of its own.
+ *
+ * Build and run with `make bench`, options in BENCH_ARGS.
+ */
+#define _GNU_SOURCE // fork, getopt, sockets
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "temp_types.h"
+#include "temp_snapshot.h"
+#include "temp_sink.h"
+#include "temp_output.h"
+#include "temp_family.h"
+#include "temp_time.h"
+#include "mqtt_output.h"
+
+#define BENCH_LIST_MAX 16
+#define BENCH_WARMUP 2
+#define BENCH_SYNC_MS 30000 // Longest wait for the broker to get a snapshot
+#define BENCH_TOPIC "bench"
+
+/* Heap allocations of all threads, glibc's own allocator underneath */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_ulong allocs = 0;
+static atomic_ulong alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, n * size, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+typedef struct counters {
+    unsigned long allocs;
+    unsigned long alloc_bytes;
+    unsigned long syscw; // Write syscalls, of files and sockets alike
+    unsigned long wchar; // Bytes written
+} counters_t;
+
+/* Without stdio, which would allocate */
+static void counters_get(counters_t *c)
+{
+    char buf[512];
+    int fd = open("/proc/self/io", O_RDONLY);
+    ssize_t len = (fd != -1) ? read(fd, buf, sizeof(buf) - 1) : -1;
+
+    buf[(len > 0) ? len : 0] = '\0';
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    char *syscw = strstr(buf, "syscw:");
+    char *wchar = strstr(buf, "wchar:");
+
+    c->syscw = (syscw != NULL) ? strtoul(syscw + 6, NULL, 10) : 0;
+    c->wchar = (wchar != NULL) ? strtoul(wchar + 6, NULL, 10) : 0;
+    c->allocs = atomic_load(&allocs);
+    c->alloc_bytes = atomic_load(&alloc_bytes);
+}
+
+/*
+ * Stand-in MQTT 3.1.1 broker, only as much as the client needs: takes one
+ * connection, acknowledges everything and tells over `sync_fd` when it got
+ * the connection and every message to <topic>/alert, which is published
+ * after each snapshot.
+ */
+static int read_full(FILE *f, uint8_t *buf, size_t len)
+{
+    return fread(buf, 1, len, f) == len ? 0 : -1;
+}
+
+static void broker(int listen_fd, int sync_fd)
+{
+    static uint8_t body[1 << 20];
+    int fd = accept(listen_fd, NULL, NULL);
+    FILE *in = (fd != -1) ? fdopen(fd, "r") : NULL;
+
+    if (in == NULL) {
+        _exit(1);
+    }
+
+    while (1) {
+        uint8_t type;
+        uint32_t len = 0;
+        int shift = 0;
+        uint8_t b;
+
+        if (read_full(in, &type, 1) != 0) {
+            break;
+        }
+
+        do {
+            if (read_full(in, &b, 1) != 0) {
+                _exit(0);
+            }
+
+            len |= (uint32_t) (b & 0x7F) << shift;
+            shift += 7;
+        } while ((b & 0x80) && shift < 28);
+
+        if (len > sizeof(body) || read_full(in, body, len) != 0) {
+            break;
+        }
+
+        switch (type >> 4) {
+            case 1: { // CONNECT
+                uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+                write(fd, connack, sizeof(connack));
+                write(sync_fd, "c", 1);
+            }
+            break;
+
+            case 3: { // PUBLISH
+                int qos = (type >> 1) & 0x03;
+                uint16_t topic_len = (body[0] << 8) | body[1];
+
+                if (qos > 0) {
+                    uint8_t puback[] = { 0x40, 0x02, body[2 + topic_len], body[3 + topic_len] };
+                    write(fd, puback, sizeof(puback));
+                }
+
+                if (topic_len >= 6 && memcmp(body + 2 + topic_len - 6, "/alert", 6) == 0) {
+                    write(sync_fd, "s", 1);
+                }
+            }
+            break;
+
+            case 8: { // SUBSCRIBE
+                uint8_t suback[] = { 0x90, 0x03, body[0], body[1], 0x01 };
+                write(fd, suback, sizeof(suback));
+            }
+            break;
+
+            case 12: { // PINGREQ
+                uint8_t pingresp[] = { 0xD0, 0x00 };
+                write(fd, pingresp, sizeof(pingresp));
+            }
+            break;
+
+            case 14: // DISCONNECT
+                _exit(0);
+        }
+    }
+
+    _exit(0);
+}
+
+static pid_t broker_pid = -1;
+static int broker_sync = -1;
+
+static int broker_wait(char expect)
+{
+    struct pollfd pfd = { .fd = broker_sync, .events = POLLIN };
+    char c;
+
+    if (poll(&pfd, 1, BENCH_SYNC_MS) != 1 || read(broker_sync, &c, 1) != 1 || c != expect) {
+        fprintf(stderr, "Stand-in MQTT broker did not answer\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int broker_start(int *port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int pipe_fd[2];
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (listen_fd == -1 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(listen_fd, 1) != 0 || getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len) != 0
+        || pipe(pipe_fd) != 0) {
+        perror("Error starting stand-in MQTT broker");
+        return -1;
+    }
+
+    broker_pid = fork();
+
+    if (broker_pid == -1) {
+        perror("Error starting stand-in MQTT broker");
+        return -1;
+    }
+
+    if (broker_pid == 0) {
+        close(pipe_fd[0]);
+        broker(listen_fd, pipe_fd[1]);
+    }
+
+    close(listen_fd);
+    close(pipe_fd[1]);
+    broker_sync = pipe_fd[0];
+    *port = ntohs(addr.sin_port);
+
+    return 0;
+}
+
+static void broker_stop()
+{
+    if (broker_pid > 0) {
+        kill(broker_pid, SIGTERM);
+        waitpid(broker_pid, NULL, 0);
+        broker_pid = -1;
+    }
+}
+
+/* Synthetic installation: sensors spread evenly over the wires, every tenth with an alias */
+static wire_t *build_wires(int wire_count, int thermo_count)
+{
+    wire_t *wires = calloc(wire_count, sizeof(wire_t));
+    thermometer_t *thermos = calloc(thermo_count, sizeof(thermometer_t));
+    const temp_family_t *family = family_get(FAMILY_DS18B20);
+    uint64_t now = time_mono_ns();
+    uint64_t wall = time_wall_ns();
+
+    if (wires == NULL || thermos == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < wire_count; i++) {
+        char device[32];
+
+        snprintf(device, sizeof(device), "/dev/ttyUSB%d", i);
+
+        wires[i].num = i;
+        wires[i].device = strdup(device);
+        wires[i].status = TEMP_STATUS_OK;
+        wires[i].thermo_max = thermo_count / wire_count + 1;
+        wires[i].thermometers = calloc(wires[i].thermo_max, sizeof(thermometer_t *));
+
+        if (wires[i].device == NULL || wires[i].thermometers == NULL) {
+            return NULL;
+        }
+    }
+
+    for (int t = 0; t < thermo_count; t++) {
+        thermometer_t *thermo = &thermos[t];
+        wire_t *wire = &wires[t % wire_count];
+        int16_t raw = 320 + (t % 400); // 20 to 45 C
+
+        thermo->address[0] = FAMILY_DS18B20;
+        thermo->address[1] = t & 0xFF;
+        thermo->address[2] = (t >> 8) & 0xFF;
+        thermo->address[3] = (t >> 16) & 0xFF;
+        thermo->address[7] = 0xA5;
+
+        thermo->scratchpad[SCR_L] = raw & 0xFF;
+        thermo->scratchpad[SCR_H] = raw >> 8;
+        thermo->scratchpad[SCR_CFG] = 0x7F;
+
+        thermo->id = t + 1;
+        thermo->family = family;
+        thermo->wire_num = wire->num;
+        thermo->status = TEMP_STATUS_OK;
+        thermo->temperature = family->convert(thermo->scratchpad);
+        thermo->ts_convert = now;
+        thermo->ts_read = now;
+        thermo->ts_wall = wall;
+
+        if (t % 10 == 0) {
+            char alias[32];
+
+            snprintf(alias, sizeof(alias), "room-%d", t);
+            thermo->alias = strdup(alias);
+        }
+
+        wire->thermometers[wire->thermo_count++] = thermo;
+    }
+
+    return wires;
+}
+
+static void free_wires(wire_t *wires, int wire_count, int thermo_count)
+{
+    thermometer_t *thermos = (wires[0].thermo_count > 0) ? wires[0].thermometers[0] : NULL;
+
+    for (int t = 0; thermos != NULL && t < thermo_count; t++) {
+        free(thermos[t].alias);
+    }
+
+    free(thermos);
+
+    for (int i = 0; i < wire_count; i++) {
+        free(wires[i].device);
+        free(wires[i].thermometers);
+    }
+
+    free(wires);
+}
+
+/* Readings change a little every cycle, as they would */
+static void next_readings(wire_t *wires, int wire_count, int cycle)
+{
+    uint64_t now = time_mono_ns();
+
+    for (int i = 0; i < wire_count; i++) {
+        for (int t = 0; t < wires[i].thermo_count; t++) {
+            thermometer_t *thermo = wires[i].thermometers[t];
+
+            thermo->temperature += ((cycle + t) % 3 - 1) * 0.0625;
+            thermo->ts_read = now;
+        }
+    }
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+typedef struct output {
+    const char *name;
+    const temp_sink_api_t *api;
+    int mqtt_binary;
+} output_t;
+
+static const output_t outputs[] = {
+    { "tsv", &tsv_sink, 0 },
+    { "json", &json_sink, 0 },
+    { "binary", &binary_sink, 0 },
+    { "mqtt", &mqtt_sink, 0 },
+    { "mqtt_binary", &mqtt_sink, 1 },
+};
+
+#define OUTPUT_COUNT ((int) (sizeof(outputs) / sizeof(outputs[0])))
+
+static void *mqtt_ctx = NULL;
+
+static int run(const output_t *out, const char *dir, wire_t *wires, int wire_count, int thermo_count, int cycles)
+{
+    static char file_name[256];
+    uint64_t *ns = calloc(cycles, sizeof(uint64_t));
+    int mqtt = (out->api == &mqtt_sink);
+    void *ctx;
+    counters_t before, after;
+
+    if (ns == NULL) {
+        return -1;
+    }
+
+    if (mqtt) {
+        mqtt_config(0, 0, out->mqtt_binary);
+        ctx = mqtt_ctx;
+    } else {
+        snprintf(file_name, sizeof(file_name), "%s/temp_bench.%s", dir, out->name);
+        ctx = out->api->open(file_name);
+    }
+
+    if (ctx == NULL) {
+        free(ns);
+        return -1;
+    }
+
+    for (int c = -BENCH_WARMUP; c < cycles; c++) {
+        next_readings(wires, wire_count, c + BENCH_WARMUP);
+
+        temp_snapshot_t *snap = snapshot_take(wires, wire_count, c);
+
+        if (snap == NULL) {
+            fprintf(stderr, "Could not take snapshot\n");
+            free(ns);
+            return -1;
+        }
+
+        if (c == 0) {
+            counters_get(&before);
+        }
+
+        uint64_t start = time_mono_ns();
+
+        out->api->write_snapshot(ctx, snap);
+
+        if (out->api->flush != NULL) {
+            out->api->flush(ctx);
+        }
+
+        /* Published after the snapshot on the same connection, so the broker got all once it got this */
+        if (mqtt) {
+            mqtt_alert("sync");
+
+            if (broker_wait('s') != 0) {
+                free(ns);
+                return -1;
+            }
+        }
+
+        if (c >= 0) {
+            ns[c] = time_mono_ns() - start;
+        }
+
+        snapshot_release(snap);
+    }
+
+    counters_get(&after);
+
+    if (!mqtt) {
+        out->api->close(ctx);
+        unlink(file_name);
+    }
+
+    qsort(ns, cycles, sizeof(uint64_t), compare_ns);
+
+    printf("%s\t%d\t%d\t%d\t%.1f\t%.1f\t%.1f\t%.1f\t%.0f\t%.1f\t%.0f\n",
+        out->name, wire_count, thermo_count, cycles,
+        ns[0] / 1000.0, ns[cycles / 2] / 1000.0, ns[cycles * 9 / 10] / 1000.0,
+        (double) (after.allocs - before.allocs) / cycles,
+        (double) (after.alloc_bytes - before.alloc_bytes) / cycles,
+        (double) (after.syscw - before.syscw) / cycles,
+        (double) (after.wchar - before.wchar) / cycles
+    );
+    fflush(stdout);
+
+    free(ns);
+
+    return 0;
+}
+
+static int parse_list(char *arg, int *list)
+{
+    int count = 0;
+
+    for (char *tok = strtok(arg, ","); tok != NULL && count < BENCH_LIST_MAX; tok = strtok(NULL, ",")) {
+        list[count] = strtol(tok, NULL, 10);
+
+        if (list[count] <= 0) {
+            return -1;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+static void usage()
+{
+    printf(
+        "Usage: temp_bench [-w <list>] [-s <list>] [-o <list>] [-n <cycles>] [-d <dir>]\n"
+        "  -w <list>    Counts of wires, default 1,10,100.\n"
+        "  -s <list>    Counts of sensors, default 10,100,1000,10000. Sizes with fewer sensors than\n"
+        "               wires are skipped.\n"
+        "  -o <list>    Outputs of tsv, json, binary, mqtt and mqtt_binary, default all.\n"
+        "  -n <cycles>  Snapshots written per output and size, default 20, after 2 not counted.\n"
+        "  -d <dir>     Directory for output files, default /dev/shm (tmpfs).\n"
+    );
+}
+
+int main(int argc, char **argv)
+{
+    int wire_counts[BENCH_LIST_MAX] = { 1, 10, 100 };
+    int thermo_counts[BENCH_LIST_MAX] = { 10, 100, 1000, 10000 };
+    int n_wires = 3, n_thermos = 4;
+    int cycles = 20;
+    const char *dir = "/dev/shm";
+    int selected[OUTPUT_COUNT];
+    int use_mqtt = 0;
+    int c;
+
+    for (int i = 0; i < OUTPUT_COUNT; i++) {
+        selected[i] = 1;
+    }
+
+    while ((c = getopt(argc, argv, "w:s:o:n:d:h")) != -1) {
+        switch (c) {
+            case 'w':
+                n_wires = parse_list(optarg, wire_counts);
+            break;
+
+            case 's':
+                n_thermos = parse_list(optarg, thermo_counts);
+            break;
+
+            case 'o':
+                memset(selected, 0, sizeof(selected));
+
+                for (char *tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                    int i;
+
+                    for (i = 0; i < OUTPUT_COUNT && strcmp(outputs[i].name, tok) != 0; i++);
+
+                    if (i == OUTPUT_COUNT) {
+                        fprintf(stderr, "Unknown output %s\n", tok);
+                        return 1;
+                    }
+
+                    selected[i] = 1;
+                }
+            break;
+
+            case 'n':
+                cycles = strtol(optarg, NULL, 10);
+            break;
+
+            case 'd':
+                dir = optarg;
+            break;
+
+            default:
+                usage();
+                return (c == 'h') ? 0 : 1;
+        }
+    }
+
+    if (n_wires <= 0 || n_thermos <= 0 || cycles <= 0) {
+        usage();
+        return 1;
+    }
+
+    for (int i = 0; i < OUTPUT_COUNT; i++) {
+        use_mqtt |= selected[i] && outputs[i].api == &mqtt_sink;
+    }
+
+    if (snapshot_pool_init(1) != 0) {
+        fprintf(stderr, "Could not allocate memory for snapshots\n");
+        return 1;
+    }
+
+    /* One connection for all sizes, as the daemon keeps it */
+    if (use_mqtt) {
+        static char mqtt_args[64];
+        int port;
+
+        if (broker_start(&port) != 0) {
+            return 1;
+        }
+
+        snprintf(mqtt_args, sizeof(mqtt_args), "127.0.0.1:%d/" BENCH_TOPIC, port);
+        mqtt_ctx = mqtt_sink.open(mqtt_args);
+
+        if (mqtt_ctx == NULL || broker_wait('c') != 0) {
+            broker_stop();
+            return 1;
+        }
+    }
+
+    printf("OUTPUT\tWIRES\tSENSORS\tCYCLES\tMIN_US\tMEDIAN_US\tP90_US\tALLOCS\tALLOC_BYTES\tWRITES\tBYTES_WRITTEN\n");
+
+    int rc = 0;
+
+    for (int o = 0; o < OUTPUT_COUNT && rc == 0; o++) {
+        if (!selected[o]) {
+            continue;
+        }
+
+        for (int w = 0; w < n_wires && rc == 0; w++) {
+            for (int t = 0; t < n_thermos && rc == 0; t++) {
+                if (thermo_counts[t] < wire_counts[w]) {
+                    continue;
+                }
+
+                wire_t *wires = build_wires(wire_counts[w], thermo_counts[t]);
+
+                if (wires == NULL) {
+                    fprintf(stderr, "Could not allocate memory for sensors\n");
+                    rc = 1;
+                    break;
+                }
+
+                rc = run(&outputs[o], dir, wires, wire_counts[w], thermo_counts[t], cycles) != 0;
+
+                free_wires(wires, wire_counts[w], thermo_counts[t]);
+            }
+        }
+    }
+
+    if (use_mqtt) {
+        mqtt_sink.close(mqtt_ctx);
+        broker_stop();
+    }
+
+    snapshot_pool_release();
+
+    return rc;
+}
@@ -0,0 +1,93 @@
+/*
+ * Decoder of the binary output format (see src/temp_binary.h): prints every
+ * reading as a tab separated line of read time, ROM, temperature and status.
+ * Reads the files given, or standard input, which may hold any count of
+ * snapshots one after another, e.g. collected from MQTT:
+ *
+ *   mosquitto_sub -t darauble/temp_daemon/batch -N | temp_decode
+ *
+ * Build with `make tools`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "temp_binary.h"
+
+static int decode(FILE *f, const char *name)
+{
+    uint8_t header[BINARY_HEADER_SIZE];
+    uint8_t rec[UINT8_MAX];
+    int count, record_size;
+    uint64_t ts_wall;
+
+    while (fread(header, BINARY_HEADER_SIZE, 1, f) == 1) {
+        int status = binary_decode_header(header, BINARY_HEADER_SIZE, &count, &record_size, &ts_wall);
+
+        if (status != 0) {
+            fprintf(stderr, "%s: %s\n", name,
+                (status == -1) ? "not a binary snapshot" : "unsupported version of binary snapshot");
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            binary_reading_t r;
+
+            if (fread(rec, record_size, 1, f) != 1) {
+                fprintf(stderr, "%s: snapshot is cut short\n", name);
+                return -1;
+            }
+
+            binary_decode_record(rec, &r);
+
+            if (r.ts_offset_ms == BINARY_NEVER_READ) {
+                printf("-\t");
+            } else {
+                int64_t ms = (int64_t) (ts_wall / 1000000) + r.ts_offset_ms;
+                printf("%" PRId64 ".%03d\t", ms / 1000, (int) (ms % 1000));
+            }
+
+            printf("%02X%02X%02X%02X%02X%02X%02X%02X\t%.4f\t%d\n",
+                r.address[0], r.address[1], r.address[2], r.address[3],
+                r.address[4], r.address[5], r.address[6], r.address[7],
+                r.raw / 16.0, r.status
+            );
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        printf("Usage: temp_decode [file...]\n"
+            "Prints readings of binary snapshots as TIME, ADDRESS, TEMPERATURE and STATUS columns.\n");
+        return 0;
+    }
+
+    if (argc == 1) {
+        return decode(stdin, "stdin") == 0 ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+
+        if (f == NULL) {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+
+        if (decode(f, argv[i]) != 0) {
+            ret = 1;
+        }
+
+        fclose(f);
+    }
+
+    return ret;
+}